@@ -2,16 +2,78 @@
 
 namespace datatypes {
 
-Graph::Graph(LInt nums) : nodes(std::make_unique<std::vector<Node>>()) {
-  nodes->reserve(nums);
+void DisjointSets::reset() {
+  for (size_t i = 0; i < parent.size(); i++) {
+    parent[i] = i;
+    size[i] = 1;
+  }
 }
 
-Graph::Graph(const std::unique_ptr<std::vector<Node>>& from_nodes) :
-  nodes(std::make_unique<std::vector<Node>>(from_nodes->begin(), from_nodes->end())) {}
+void PackedCover::pack(SampleScratch& scratch, bool sparse) {
+  // built in scratch, then copied into arrays of just the right size, reusing
+  // the ones the last pack left when they are big enough.
+  auto& dsets = scratch.dsets;
+  auto& sizes = scratch.comp_sizes;
+  auto& listed = scratch.listed;
+  mapping.reset();
 
-void ConnectedComp::add(const Node& node) {
-  if (node.id < id) id = node.id;
-  size += 1;
+  this->sparse = sparse;
+  num_nodes = dsets.parent.size();
+  sizes.assign(1, 1);
+  listed.clear();
+  implicit = 0;
+
+  // roots are the smallest ids of their components, so a root is always met
+  // before the rest of its component.
+  auto& index = scratch.index;
+  index.resize(num_nodes);
+  LInt num_singletons = 0;
+  for (LInt i = 0; i < num_nodes; i++) {
+    auto r = dsets.find(i);
+    if (r != i) {
+      index[i] = index[r];
+    } else if (dsets.size[i] == 1) {
+      index[i] = 0;
+      num_singletons++;
+    } else {
+      index[i] = sizes.size();
+      sizes.push_back(dsets.size[i]);
+    }
+  }
+
+  bits = 0;
+  while ((std::uint64_t(1) << bits) < sizes.size()) bits++;
+
+  if (sparse) {
+    auto giant = std::max_element(sizes.begin() + 1, sizes.end());
+    if (giant != sizes.end() && *giant > num_singletons) implicit = giant - sizes.begin();
+
+    for (LInt i = 0; i < num_nodes; i++) {
+      if (index[i] != implicit) listed.push_back(i);
+    }
+  }
+
+  LInt num_slots = sparse ? listed.size() : num_nodes;
+  auto words = this->words.release();
+  words.assign((num_slots * bits + 63) / 64 + 1, 0);
+
+  for (LInt k = 0; bits > 0 && k < num_slots; k++) {
+    std::uint64_t c = index[sparse ? listed[k] : k];
+    std::uint64_t pos = k * bits;
+    auto w = pos >> 6;
+    auto off = pos & 63;
+    words[w] |= c << off;
+    if (off + bits > 64) words[w + 1] |= c >> (64 - off);
+  }
+
+  auto own_sizes = this->sizes.release();
+  own_sizes.assign(sizes.begin(), sizes.end());
+  auto own_listed = this->listed.release();
+  own_listed.assign(listed.begin(), listed.end());
+
+  this->sizes = util::Array<VInt>(std::move(own_sizes));
+  this->listed = util::Array<VInt>(std::move(own_listed));
+  this->words = util::Array<std::uint64_t>(std::move(words));
 }
 
 }
@@ -4,65 +4,157 @@
 #include <tuple>
 #include <memory>
 #include <vector>
+#include <utility>
+#include <cstdint>
+#include <algorithm>
+#include "util.h"
 
 
 namespace datatypes {
 
 using LInt = long long int;
 
+// internal vertex id, dense in [0, n).
+using VInt = std::uint32_t;
+
+// (internal id, id in the input file), indexed by internal id.
 using Vertex = std::tuple<LInt, LInt>;
 
 using Edge = std::tuple<LInt, LInt, double>;
 
+// edges in compressed sparse row form: the edges read as (u, v) are
+// targets[offsets[u] .. offsets[u+1]), in increasing v, with activation probs[e].
+// the arrays own their storage, or point into mapping when loaded from a cache.
+struct EdgesCSR {
+  util::Array<LInt> offsets;
+  util::Array<VInt> targets;
+  util::Array<float> probs;
+  std::unique_ptr<util::MappedFile> mapping;
+
+  inline LInt num_nodes() const { return offsets.size() - 1; }
+  inline LInt num_edges() const { return targets.size(); }
+};
+
 struct GraphByEdges {
   std::unique_ptr<std::vector<Vertex>> vertexes;
-  std::unique_ptr<std::vector<Edge>> edges;
+  std::unique_ptr<EdgesCSR> edges;
 
   GraphByEdges(
     std::unique_ptr<std::vector<Vertex>> &&pV,
-    std::unique_ptr<std::vector<Edge>> &&pE)
+    std::unique_ptr<EdgesCSR> &&pE)
   : vertexes(std::move(pV)), edges(std::move(pE)) {}
 
   GraphByEdges (const GraphByEdges&) = delete;
   GraphByEdges& operator= (const GraphByEdges&) = delete;
-};
-
-struct ConnectedComp;
-
-struct Node {
-  LInt id;
-  LInt attr;
-  ConnectedComp* ccomp;
-  std::vector<Node*> neighbors;
 
-  Node() : id(-1), attr(-1), ccomp(nullptr) {}
-  Node(LInt id, LInt attr) : id(id), attr(attr), ccomp(nullptr) {}
+  inline LInt num_nodes() const { return vertexes->size(); }
 };
 
-struct ConnectedComp {
-  LInt id;
-  LInt size;
-
-  ConnectedComp() : id(-1), size(0) {}
-
-  ConnectedComp(const Node &node) : id(node.id), size(1) {}
-
-  void add(const Node& node);
+// union-find over node ids, reused across samples; the root of every set is its
+// smallest node id.
+struct DisjointSets {
+  std::vector<VInt> parent;
+  std::vector<VInt> size;
+
+  DisjointSets() {}
+  DisjointSets(LInt nums) : parent(nums), size(nums) { reset(); }
+
+  void reset();
+
+  inline VInt find(VInt u) {
+    while (parent[u] != u) {
+      parent[u] = parent[parent[u]];
+      u = parent[u];
+    }
+    return u;
+  }
+
+  inline void unite(VInt u, VInt v) {
+    u = find(u);
+    v = find(v);
+    if (u == v) return;
+    if (v < u) std::swap(u, v);
+    parent[v] = u;
+    size[u] += size[v];
+  }
 };
 
-struct Graph {
-  std::unique_ptr<std::vector<Node>> nodes;
-
-  Graph(LInt nums);
-  Graph(const std::unique_ptr<std::vector<Node>>& from_nodes);
-
-  Graph (const Graph&) = delete;
-  Graph& operator= (const Graph&) = delete;
+// one thread's working memory for drawing and packing samples, reused from
+// sample to sample and kept at its high-water mark: the union-find a sample's
+// components are built in, and the buffers of PackedCover::pack, of bitpar
+// batches and of activation levels.
+struct SampleScratch {
+  DisjointSets dsets;
+  std::vector<VInt> index;  // PackedCover::pack
+  std::vector<VInt> comp_sizes;  // PackedCover::pack
+  std::vector<VInt> listed;  // PackedCover::pack
+  std::vector<std::vector<std::pair<VInt, VInt>>> lane_edges;  // bitpar batches
+  std::vector<std::vector<LInt>> level_edges;  // activation levels
+
+  SampleScratch() {}
+  SampleScratch(LInt nums) : dsets(nums) {}
 };
 
-struct NodeIndexedCover {
-  LInt cc_id;
-  LInt cc_size;
+// one sample's labeling, bit-packed: every node of a component with two or more
+// nodes stores its component's index in [1, num_comps()) in `bits` bits, and all
+// singletons share index 0, since a singleton is only ever covered by itself.
+// sizes[c] is the size of component c, with sizes[0] = 1. this takes
+// bits / 8 bytes per node plus 4 per non-trivial component, against 16 bytes
+// per node for an unpacked (component id, size) pair.
+//
+// a sparse cover leaves out the nodes of its largest class, either the giant
+// component or the singletons, whichever holds more nodes: they all take the
+// index `implicit`, and only the remaining nodes are listed, in id order, with
+// their indexes packed by position. a dense cover lists every node, so
+// position k is node k. kernels walk the listed nodes and account for the
+// implicit ones once per sample.
+struct PackedCover {
+  util::Array<std::uint64_t> words;
+  util::Array<VInt> sizes;
+  util::Array<VInt> listed;  // sparse only
+  std::shared_ptr<util::MappedFile> mapping;  // what the arrays view, if stored
+  LInt num_nodes;
+  int bits;
+  bool sparse;
+  VInt implicit;
+
+  PackedCover() : num_nodes(0), bits(0), sparse(false), implicit(0) {}
+
+  // packs the components currently held by scratch.dsets.
+  void pack(SampleScratch& scratch, bool sparse = false);
+
+  // the component index at position k.
+  inline VInt comp_at(LInt k) const {
+    if (bits == 0) return 0;
+    std::uint64_t pos = k * bits;
+    auto w = pos >> 6;
+    auto off = pos & 63;
+    std::uint64_t v = words[w] >> off;
+    if (off + bits > 64) v |= words[w + 1] << (64 - off);
+    return v & ((std::uint64_t(1) << bits) - 1);
+  }
+
+  inline LInt num_listed() const { return sparse ? (LInt)listed.size() : num_nodes; }
+  inline VInt node_at(LInt k) const { return sparse ? listed[k] : k; }
+
+  // the first position whose node is i or above.
+  inline LInt lower(LInt i) const {
+    if (!sparse) return i;
+    return std::lower_bound(listed.begin(), listed.end(), i) - listed.begin();
+  }
+
+  // the component index of node i.
+  inline VInt comp(LInt i) const {
+    if (!sparse) return comp_at(i);
+    auto k = lower(i);
+    if (k < (LInt)listed.size() && listed[k] == i) return comp_at(k);
+    return implicit;
+  }
+
+  inline LInt num_comps() const { return sizes.size(); }
+  inline size_t bytes() const {
+    return words.size() * 8 + (sizes.size() + listed.size()) * sizeof(VInt);
+  }
 };
 
 struct NodeMeasure {
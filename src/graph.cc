@@ -1,13 +1,26 @@
 #include <memory>
 #include <vector>
 #include <set>
+#include <unordered_map>
 #include <tuple>
 #include <algorithm>
 #include <iterator>
 #include <functional>
-#include <fstream>
 #include <string>
+#include <cstring>
+#include <numeric>
+#include <limits>
+#include <stdexcept>
 #include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cmath>
+#include <omp.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
 #include "datatypes.h"
 #include "util.h"
 #include "graph.h"
@@ -16,165 +29,1029 @@ namespace graph {
 
 using std::make_unique;
 using std::unique_ptr;
-using std::make_tuple;
 using std::vector;
 using std::set;
 using datatypes::LInt;
 using datatypes::GraphByEdges;
 using datatypes::Vertex;
-using datatypes::Edge;
-using datatypes::Graph;
-using datatypes::Node;
-using datatypes::ConnectedComp;
-using datatypes::NodeIndexedCover;
-using util::Dice;
+using datatypes::VInt;
+using datatypes::EdgesCSR;
+using datatypes::DisjointSets;
 using util::STDice;
 
+// parse the "u v" lines that start in [begin, end) into flat (u, v) pairs.
+// comment lines (#) and empty lines are skipped, as is anything after v.
+void _parse_edge_chunk(const char* begin, const char* end, vector<LInt>& out) {
+  auto p = begin;
+
+  auto skip_blanks = [&p, end]() {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+  };
+
+  auto parse_int = [&p, end](LInt& x) -> bool {
+    bool neg = false;
+    if (p < end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+    if (p == end || *p < '0' || *p > '9') return false;
+    x = 0;
+    while (p < end && *p >= '0' && *p <= '9') x = x * 10 + (*p++ - '0');
+    if (neg) x = -x;
+    return true;
+  };
+
+  while (p < end) {
+    if (*p != '#' && *p != '\n') {
+      LInt u, v;
+      skip_blanks();
+      bool ok = parse_int(u);
+      skip_blanks();
+      if (ok && parse_int(v)) {
+        out.push_back(u);
+        out.push_back(v);
+      }
+    }
+    p = static_cast<const char*>(std::memchr(p, '\n', end - p));
+    if (p == nullptr) break;
+    p++;
+  }
+}
+
 std::unique_ptr<datatypes::GraphByEdges> read_edges(
     const std::string &fname, const double &activation, const int &seed) {
 
-  struct VertexCompare {
-    bool operator() (const datatypes::Vertex &lhs, const datatypes::Vertex &rhs) const {
-      return std::get<1>(lhs) < std::get<1>(rhs);
+  auto file = util::MappedFile(fname);
+  auto data = file.data();
+  auto len = file.size();
+
+  // split the file into one chunk per thread, each starting at a line start.
+  int num_chunks = len > (1 << 20) ? omp_get_max_threads() : 1;
+  auto bounds = vector<const char*>(num_chunks + 1, data + len);
+  bounds[0] = data;
+  for (int i = 1; i < num_chunks; i++) {
+    auto p = data + len / num_chunks * i;
+    auto nl = static_cast<const char*>(std::memchr(p, '\n', data + len - p));
+    bounds[i] = (nl == nullptr) ? data + len : std::max(nl + 1, bounds[i - 1]);
+  }
+
+  auto chunks = vector<vector<LInt>>(num_chunks);
+
+  #pragma omp parallel for schedule(static, 1)
+  for (int i = 0; i < num_chunks; i++) {
+    chunks[i].reserve((bounds[i + 1] - bounds[i]) / 6);
+    _parse_edge_chunk(bounds[i], bounds[i + 1], chunks[i]);
+  }
+
+  size_t num_lines = 0;
+  for (auto& c: chunks) num_lines += c.size() / 2;
+
+  // internal ids follow the order of first appearance, u before v, and the
+  // random activations are drawn one per line, so both match the file order.
+  auto ids = std::unordered_map<LInt, VInt>();
+  ids.reserve(num_lines / 2);
+  auto vV = make_unique<vector<Vertex>>();
+  auto src = vector<VInt>(num_lines);
+  auto dst = vector<VInt>(num_lines);
+  auto acts = vector<double>(num_lines, activation);
+  auto dice = STDice(seed, 0.001, 0.05);
+
+  auto get_id = [&ids, &vV](LInt x) -> VInt {
+    auto iter_bool = ids.emplace(x, vV->size());
+    if (iter_bool.second) {
+      if (vV->size() == std::numeric_limits<VInt>::max()) {
+        throw std::length_error("read_edges: too many vertexes for 32-bit ids");
+      }
+      vV->emplace_back(vV->size(), x);
     }
+    return iter_bool.first->second;
   };
 
-  auto pV = make_unique<set<Vertex, VertexCompare>>();
-  auto pE = make_unique<set<Edge>>();
+  size_t k = 0;
+  for (auto& c: chunks) {
+    for (size_t i = 0; i < c.size(); i += 2, k++) {
+      src[k] = get_id(c[i]);
+      dst[k] = get_id(c[i + 1]);
+      if (activation <= 0) acts[k] = dice.roll();
+    }
+    vector<LInt>().swap(c);
+  }
 
-  auto fin = std::ifstream(fname);
-  std::string line;
-  auto dice = STDice(seed, 0.001, 0.05);
+  LInt n = vV->size();
 
-  LInt u, v;
-  LInt counter = 0;
+  // bucket the lines by source, then sort-unique each row on (v, activation).
+  auto row_offsets = vector<LInt>(n + 1, 0);
+  for (size_t i = 0; i < num_lines; i++) row_offsets[src[i] + 1]++;
+  std::partial_sum(row_offsets.begin(), row_offsets.end(), row_offsets.begin());
 
-  while (getline(fin, line)) {
-    if (line[0] == '#' || line.empty()) continue;
+  auto rows = vector<std::pair<VInt, double>>(num_lines);
+  auto cursor = vector<LInt>(row_offsets.begin(), row_offsets.end() - 1);
+  for (size_t i = 0; i < num_lines; i++) {
+    rows[cursor[src[i]]++] = std::make_pair(dst[i], acts[i]);
+  }
 
-    std::istringstream(line) >> u >> v;
+  auto offsets = vector<LInt>(n + 1, 0);
 
-    auto tu = make_tuple(counter, u);
-    counter++;
-    auto find_tu = pV->find(tu);
-    if (pV->find(tu) == pV->end()) {
-      pV->insert(tu);
-    } else {
-      tu = *find_tu;
-      counter--;
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for (LInt u = 0; u < n; u++) {
+    auto first = rows.begin() + row_offsets[u];
+    auto last = rows.begin() + row_offsets[u + 1];
+    std::sort(first, last);
+    offsets[u + 1] = std::unique(first, last) - first;
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  auto targets = vector<VInt>(offsets[n]);
+  auto probs = vector<float>(offsets[n]);
+
+  #pragma omp parallel for schedule(dynamic, 1024)
+  for (LInt u = 0; u < n; u++) {
+    auto from = row_offsets[u];
+    for (LInt e = offsets[u]; e < offsets[u + 1]; e++, from++) {
+      targets[e] = rows[from].first;
+      probs[e] = rows[from].second;
     }
+  }
 
-    auto tv = make_tuple(counter, v);
-    counter++;
-    auto find_tv = pV->find(tv);
-    if (pV->find(tv) == pV->end()) {
-      pV->insert(tv);
-    } else {
-      tv = *find_tv;
-      counter--;
+  auto csr = make_unique<EdgesCSR>();
+  csr->offsets = std::move(offsets);
+  csr->targets = std::move(targets);
+  csr->probs = std::move(probs);
+
+  return make_unique<GraphByEdges>(std::move(vV), std::move(csr));
+}
+
+namespace {
+
+const char graph_cache_magic[8] = {'P', 'I', 'N', 'F', 'G', 'R', 'P', 'H'};
+const std::uint32_t graph_cache_version = 1;
+
+struct GraphCacheHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t path_len;
+  std::int64_t mtime_sec;
+  std::int64_t mtime_nsec;
+  std::int64_t file_size;
+  double activation;
+  std::int64_t seed;
+  std::int64_t num_nodes;
+  std::int64_t num_edges;
+};
+
+inline size_t _align8(size_t x) { return (x + 7) & ~size_t(7); }
+
+// the header expected for fname; path_len is 0 if fname cannot be stat'ed.
+GraphCacheHeader _graph_cache_key(
+    const std::string &path, const double &activation, const int &seed) {
+
+  GraphCacheHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, graph_cache_magic, sizeof(h.magic));
+  h.version = graph_cache_version;
+  h.activation = activation;
+  h.seed = seed;
+
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) return h;
+  h.path_len = path.size();
+  h.mtime_sec = st.st_mtim.tv_sec;
+  h.mtime_nsec = st.st_mtim.tv_nsec;
+  h.file_size = st.st_size;
+  return h;
+}
+
+// layout: header, input path, external ids [n], offsets [n + 1], targets [m],
+// probs [m], each section starting on an 8-byte boundary.
+unique_ptr<GraphByEdges> _map_graph_cache(
+    const std::string &cache_file, const std::string &path, const GraphCacheHeader &key) {
+
+  struct stat st;
+  if (stat(cache_file.c_str(), &st) != 0) return nullptr;
+
+  auto file = make_unique<util::MappedFile>(cache_file);
+  auto base = file->data();
+  if (file->size() < sizeof(GraphCacheHeader)) return nullptr;
+
+  GraphCacheHeader h;
+  std::memcpy(&h, base, sizeof(h));
+  if (std::memcmp(h.magic, key.magic, sizeof(h.magic)) != 0 || h.version != key.version ||
+      h.path_len != key.path_len || h.mtime_sec != key.mtime_sec ||
+      h.mtime_nsec != key.mtime_nsec || h.file_size != key.file_size ||
+      h.activation != key.activation || h.seed != key.seed) return nullptr;
+
+  size_t pos = sizeof(h);
+  if (file->size() < pos + h.path_len ||
+      path.compare(0, std::string::npos, base + pos, h.path_len) != 0) return nullptr;
+  pos = _align8(pos + h.path_len);
+
+  if (h.num_nodes < 0 || h.num_edges < 0 ||
+      h.num_nodes > (std::int64_t)std::numeric_limits<VInt>::max() ||
+      (size_t)h.num_nodes > file->size() / sizeof(LInt) ||
+      (size_t)h.num_edges > file->size() / sizeof(VInt)) return nullptr;
+  size_t n = h.num_nodes, m = h.num_edges;
+  auto ids_pos = pos;
+  auto offsets_pos = _align8(ids_pos + n * sizeof(LInt));
+  auto targets_pos = _align8(offsets_pos + (n + 1) * sizeof(LInt));
+  auto probs_pos = _align8(targets_pos + m * sizeof(VInt));
+  if (file->size() < probs_pos + m * sizeof(float)) return nullptr;
+
+  // the samplers index by these without checks, so a file whose header holds
+  // but whose rows run backwards, past the edges, or to a node that is not
+  // there is parsed again like a stale one.
+  auto offsets = reinterpret_cast<const LInt*>(base + offsets_pos);
+  auto targets = reinterpret_cast<const VInt*>(base + targets_pos);
+  if (offsets[0] != 0 || offsets[n] != (LInt)m) return nullptr;
+  for (size_t u = 0; u < n; u++) {
+    if (offsets[u + 1] < offsets[u]) return nullptr;
+  }
+  for (size_t e = 0; e < m; e++) {
+    if (targets[e] >= n) return nullptr;
+  }
+
+  auto ids = reinterpret_cast<const LInt*>(base + ids_pos);
+  auto vV = make_unique<vector<Vertex>>();
+  vV->reserve(n);
+  for (size_t i = 0; i < n; i++) vV->emplace_back(i, ids[i]);
+
+  auto csr = make_unique<EdgesCSR>();
+  csr->offsets = util::Array<LInt>(offsets, n + 1);
+  csr->targets = util::Array<VInt>(targets, m);
+  csr->probs = util::Array<float>(reinterpret_cast<const float*>(base + probs_pos), m);
+  csr->mapping = std::move(file);
+
+  return make_unique<GraphByEdges>(std::move(vV), std::move(csr));
+}
+
+// write to a temporary name and rename, so concurrent runs never map a partial file.
+void _write_graph_cache(
+    const std::string &cache_file, const std::string &path, GraphCacheHeader h,
+    const unique_ptr<GraphByEdges>& graph_edges) {
+
+  auto& csr = *(graph_edges->edges);
+  h.num_nodes = graph_edges->num_nodes();
+  h.num_edges = csr.num_edges();
+
+  auto tmp_file = cache_file + ".tmp." + std::to_string(getpid());
+  std::FILE* out = std::fopen(tmp_file.c_str(), "wb");
+  if (out == nullptr) return;
+
+  size_t pos = 0;
+  auto put = [&out, &pos](const void* p, size_t len) {
+    static const char zeros[8] = {0};
+    std::fwrite(zeros, 1, _align8(pos) - pos, out);
+    pos = _align8(pos);
+    std::fwrite(p, 1, len, out);
+    pos += len;
+  };
+
+  put(&h, sizeof(h));
+  put(path.data(), path.size());
+
+  auto ids = vector<LInt>();
+  ids.reserve(h.num_nodes);
+  for (auto& x: *(graph_edges->vertexes)) ids.push_back(std::get<1>(x));
+  put(ids.data(), ids.size() * sizeof(LInt));
+  put(csr.offsets.data(), csr.offsets.size() * sizeof(LInt));
+  put(csr.targets.data(), csr.targets.size() * sizeof(VInt));
+  put(csr.probs.data(), csr.probs.size() * sizeof(float));
+
+  bool ok = (std::ferror(out) == 0);
+  ok = (std::fclose(out) == 0) && ok;
+  if (ok) ok = (std::rename(tmp_file.c_str(), cache_file.c_str()) == 0);
+  if (!ok) std::remove(tmp_file.c_str());
+}
+
+}
+
+std::unique_ptr<datatypes::GraphByEdges> read_edges_cached(
+    const std::string &fname, const double &activation, const int &seed,
+    const std::string &cache_dir) {
+
+  char* resolved = realpath(fname.c_str(), nullptr);
+  if (resolved == nullptr) return read_edges(fname, activation, seed);
+  auto path = std::string(resolved);
+  std::free(resolved);
+
+  auto key = _graph_cache_key(path, activation, seed);
+
+  std::ostringstream key_str;
+  key_str << path << "|" << key.mtime_sec << "." << key.mtime_nsec << "|" << key.file_size
+    << "|" << std::hexfloat << activation << "|" << seed;
+
+  std::ostringstream name;
+  name << cache_dir << "/" << path.substr(path.find_last_of('/') + 1) << "."
+    << std::hex << std::hash<std::string>()(key_str.str()) << ".v" << graph_cache_version
+    << ".bin";
+  auto cache_file = name.str();
+
+  auto graph_edges = _map_graph_cache(cache_file, path, key);
+  if (graph_edges) return graph_edges;
+
+  graph_edges = read_edges(fname, activation, seed);
+  _write_graph_cache(cache_file, path, key, graph_edges);
+  return graph_edges;
+}
+
+// turns the Philox word w of an edge into its draw: w ^ flip, or for sample j
+// of a stratified group, a stratum from a permutation of the strata keyed on
+// w, ((j ^ a) * m) & 31, an xorshift, then * 13 + c, with odd m, so each of the
+// 32 samples of the group gets its own, jittered within it by the rest of w at
+// 2^-23 resolution.
+struct EdgeDraw {
+  std::uint32_t flip;
+  bool stratified;
+  std::uint32_t j;
+
+  inline std::uint32_t operator()(std::uint32_t w) const {
+    if (!stratified) return w ^ flip;
+    std::uint32_t x = ((j ^ (w & 31)) * (((w >> 5) & 15) * 2 + 1)) & 31;
+    x ^= x >> 2;
+    x = (x * 13 + (w >> 9)) & 31;
+    return (x << 27) | ((w >> 14) << 9);
+  }
+};
+
+// edge-mode live-edge selection over the edges [begin, end): writes e - begin
+// for every e whose draw is below probs[e] to live, in order, and returns how
+// many. e's draw comes from word e & 3 of Philox block e >> 2, which is word e
+// of the stream, through draw; begin is a multiple of 4.
+using LiveEdgeKernel = LInt (*)(
+  const util::Philox&, const EdgeDraw&, const float*, LInt, LInt, VInt*);
+
+LInt _live_edges_scalar(
+    const util::Philox& gen, const EdgeDraw& draw,
+    const float* probs, LInt begin, LInt end, VInt* live) {
+
+  LInt count = 0;
+  util::Philox::Block block{};
+  for (LInt e = begin; e < end; e++) {
+    if ((e & 3) == 0) block = gen.block(e >> 2);
+    live[count] = e - begin;
+    count += util::Philox::to_float(draw(block[e & 3])) < probs[e];
+  }
+  return count;
+}
+
+#if defined(__x86_64__)
+// high 32 bits of the 8 products a[i] * m[i].
+__attribute__((target("avx2")))
+inline __m256i _mulhi_epu32(__m256i a, __m256i m) {
+  auto even = _mm256_srli_epi64(_mm256_mul_epu32(a, m), 32);
+  auto odd = _mm256_mul_epu32(_mm256_srli_epi64(a, 32), _mm256_srli_epi64(m, 32));
+  return _mm256_blend_epi32(even, odd, 0xAA);
+}
+
+// runs 8 Philox blocks side by side, one per lane, so 32 edges at a time, then
+// transposes the words back into edge order and compares 8 edges per vector.
+// the uniforms are the same floats to_float gives, so the live edges are too.
+// EdgeDraw on 8 words.
+__attribute__((target("avx2")))
+inline __m256i _draws_avx2(const EdgeDraw& draw, __m256i w) {
+  if (!draw.stratified) return _mm256_xor_si256(w, _mm256_set1_epi32(draw.flip));
+  const auto five = _mm256_set1_epi32(31);
+  auto a = _mm256_and_si256(w, five);
+  auto m = _mm256_or_si256(
+    _mm256_and_si256(_mm256_srli_epi32(w, 4), _mm256_set1_epi32(30)), _mm256_set1_epi32(1));
+  auto x = _mm256_and_si256(
+    _mm256_mullo_epi32(_mm256_xor_si256(_mm256_set1_epi32(draw.j), a), m), five);
+  x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 2));
+  x = _mm256_and_si256(
+    _mm256_add_epi32(_mm256_mullo_epi32(x, _mm256_set1_epi32(13)), _mm256_srli_epi32(w, 9)),
+    five);
+  return _mm256_or_si256(
+    _mm256_slli_epi32(x, 27), _mm256_slli_epi32(_mm256_srli_epi32(w, 14), 9));
+}
+
+__attribute__((target("avx2")))
+LInt _live_edges_avx2(
+    const util::Philox& gen, const EdgeDraw& draw,
+    const float* probs, LInt begin, LInt end, VInt* live) {
+
+  auto w = gen.words();
+  const auto m0 = _mm256_set1_epi32(0xD2511F53);
+  const auto m1 = _mm256_set1_epi32(0xCD9E8D57);
+  const auto scale = _mm256_set1_ps(1.0f / 16777216);
+
+  LInt count = 0;
+  LInt e = begin;
+  for (; e + 32 <= end; e += 32) {
+    std::uint64_t b = e >> 2;
+    __m256i c0 = _mm256_setr_epi32(
+      b, b + 1, b + 2, b + 3, b + 4, b + 5, b + 6, b + 7);
+    __m256i c1 = _mm256_setr_epi32(
+      b >> 32, (b + 1) >> 32, (b + 2) >> 32, (b + 3) >> 32,
+      (b + 4) >> 32, (b + 5) >> 32, (b + 6) >> 32, (b + 7) >> 32);
+    __m256i c2 = _mm256_set1_epi32(w[2]);
+    __m256i c3 = _mm256_set1_epi32(w[3]);
+    std::uint32_t k0 = w[0], k1 = w[1];
+
+    for (int r = 0; r < 10; r++) {
+      auto lo0 = _mm256_mullo_epi32(c0, m0);
+      auto hi0 = _mm256_xor_si256(_mulhi_epu32(c0, m0), c3);
+      auto lo1 = _mm256_mullo_epi32(c2, m1);
+      auto hi1 = _mm256_xor_si256(_mulhi_epu32(c2, m1), c1);
+      c0 = _mm256_xor_si256(hi1, _mm256_set1_epi32(k0));
+      c1 = lo1;
+      c2 = _mm256_xor_si256(hi0, _mm256_set1_epi32(k1));
+      c3 = lo0;
+      k0 += 0x9E3779B9;
+      k1 += 0xBB67AE85;
     }
 
-    if (activation > 0) {
-      pE->insert(make_tuple(std::get<0>(tu), std::get<0>(tv), activation));
-    } else {
-      pE->insert(make_tuple(std::get<0>(tu), std::get<0>(tv), dice.roll()));
+    // lane i holds word j of block b + i in cj; edge 4 * i + j wants it at
+    // position 4 * i + j.
+    auto t0 = _mm256_unpacklo_epi32(c0, c1);
+    auto t1 = _mm256_unpackhi_epi32(c0, c1);
+    auto t2 = _mm256_unpacklo_epi32(c2, c3);
+    auto t3 = _mm256_unpackhi_epi32(c2, c3);
+    auto u0 = _mm256_unpacklo_epi64(t0, t2);
+    auto u1 = _mm256_unpackhi_epi64(t0, t2);
+    auto u2 = _mm256_unpacklo_epi64(t1, t3);
+    auto u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i words[4] = {
+      _mm256_permute2x128_si256(u0, u1, 0x20), _mm256_permute2x128_si256(u2, u3, 0x20),
+      _mm256_permute2x128_si256(u0, u1, 0x31), _mm256_permute2x128_si256(u2, u3, 0x31)};
+
+    for (int q = 0; q < 4; q++) {
+      auto x = _draws_avx2(draw, words[q]);
+      auto u = _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(x, 8)), scale);
+      auto p = _mm256_loadu_ps(probs + e + 8 * q);
+      unsigned mask = _mm256_movemask_ps(_mm256_cmp_ps(u, p, _CMP_LT_OQ));
+      while (mask != 0) {
+        live[count++] = e + 8 * q + __builtin_ctz(mask) - begin;
+        mask &= mask - 1;
+      }
     }
   }
 
-  fin.close();
+  auto tail = _live_edges_scalar(gen, draw, probs, e, end, live + count);
+  for (LInt k = count; k < count + tail; k++) live[k] += e - begin;
+  return count + tail;
+}
+#endif
+
+// picks the AVX2 kernel when the CPU has it.
+LiveEdgeKernel _live_edge_kernel() {
+#if defined(__x86_64__)
+  static const LiveEdgeKernel kernel =
+    __builtin_cpu_supports("avx2") ? _live_edges_avx2 : _live_edges_scalar;
+  return kernel;
+#else
+  return _live_edges_scalar;
+#endif
+}
+
+// the lanes of `lanes` in which edge e is live, for the batch drawn by gen.
+// lane w reads bit w of successive 64-bit words as the binary digits of a
+// uniform U and is live when U < p. all lanes are compared against the digits
+// of p at once, and a lane drops out at its first digit that differs, so a
+// full batch needs about log2(64) + 2 words per edge. p is taken to 32 bits.
+// a lane's result does not depend on which other lanes are asked for.
+inline std::uint64_t _live_lanes(
+    const util::Philox& gen, const LInt& e, const float& p, std::uint64_t lanes) {
+
+  if (!(p > 0)) return 0;
+  if (p >= 1) return lanes;
+  auto thr = static_cast<std::uint32_t>(std::ldexp(static_cast<double>(p), 32));
+
+  std::uint64_t live = 0;
+  util::Philox::Block block{};
+  for (int j = 0; j < 32 && lanes != 0; j++) {
+    std::uint32_t rest = thr << j;
+    if (rest == 0) break;  // U >= p in every lane still tied
+
+    if ((j & 1) == 0) block = gen.block(std::uint64_t(e) * 16 + (j >> 1));
+    auto r = std::uint64_t(block[2 * (j & 1)]) | (std::uint64_t(block[2 * (j & 1) + 1]) << 32);
+    if (rest >> 31) {
+      live |= lanes & ~r;
+      lanes &= r;
+    } else {
+      lanes &= ~r;
+    }
+  }
+  return live;
+}
 
-  auto vV = make_unique<vector<Vertex>>(pV->size());
-  std::copy(pV->begin(), pV->end(), vV->begin());
+SamplingMode parse_sampling_mode(const std::string &name) {
+  if (name == "edge") return SamplingMode::edge;
+  if (name == "skip") return SamplingMode::skip;
+  if (name == "bitpar") return SamplingMode::bitpar;
+  throw std::invalid_argument("unknown sampling mode: " + name);
+}
 
-  auto vE = make_unique<vector<Edge>>(pE->begin(), pE->end());
+CoverEncoding parse_cover_encoding(const std::string &name) {
+  if (name == "dense") return CoverEncoding::dense;
+  if (name == "sparse") return CoverEncoding::sparse;
+  throw std::invalid_argument("unknown cover encoding: " + name);
+}
 
-  return make_unique<GraphByEdges>(std::move(vV), std::move(vE));
+SampleDesign parse_sample_design(const std::string &name) {
+  if (name == "mc") return SampleDesign::mc;
+  if (name == "antithetic") return SampleDesign::antithetic;
+  if (name == "stratified") return SampleDesign::stratified;
+  throw std::invalid_argument("unknown sample design: " + name);
 }
 
-std::unique_ptr<std::vector<datatypes::Node>> get_graph_nodes(
-    const std::unique_ptr<datatypes::GraphByEdges>& graph_edges) {
+Sampler::Sampler(
+    const std::unique_ptr<datatypes::GraphByEdges>& graph_edges,
+    SamplingMode mode,
+    CoverEncoding encoding,
+    SampleDesign design) :
+  graph_edges(graph_edges), mode(mode), encoding(encoding), design(design),
+  fingerprint(0), budget(0) {
 
-  auto vertices = *(graph_edges->vertexes);
-  auto nodes = make_unique<vector<Node>>();
-  nodes->resize(vertices.size());
+  if (design != SampleDesign::mc && mode != SamplingMode::edge) {
+    throw std::invalid_argument("antithetic and stratified samples need edge sampling");
+  }
 
-  for (auto x : vertices) {
-    auto i = std::get<0>(x);
-    nodes->at(i) = Node(i, std::get<1>(x));
+  if (mode == SamplingMode::edge) {
+    auto& csr = *(graph_edges->edges);
+    sources.resize(csr.num_edges());
+    for (LInt u = 0; u < csr.num_nodes(); u++) {
+      std::fill(sources.begin() + csr.offsets[u], sources.begin() + csr.offsets[u + 1], u);
+    }
+  }
+
+  if (mode != SamplingMode::skip) return;
+
+  // bucket b holds the edges with p in (2^-(b+1), 2^-b].
+  const int max_buckets = 64;
+  auto& csr = *(graph_edges->edges);
+  buckets.resize(max_buckets);
+  for (auto& b: buckets) {
+    b.p_max = 0;
+    b.uniform = true;
+  }
+
+  for (LInt u = 0; u < csr.num_nodes(); u++) {
+    for (LInt e = csr.offsets[u]; e < csr.offsets[u + 1]; e++) {
+      auto p = csr.probs[e];
+      if (!(p > 0)) continue;
+      int k = p >= 1 ? 0 : std::min<int>(max_buckets - 1, std::floor(-std::log2(p)));
+      auto& b = buckets[k];
+      if (!b.probs.empty() && p != b.probs.back()) b.uniform = false;
+      b.p_max = std::max(b.p_max, p);
+      b.src.push_back(u);
+      b.dst.push_back(csr.targets[e]);
+      b.probs.push_back(p);
+    }
   }
-  return nodes;
+
+  buckets.erase(
+    std::remove_if(buckets.begin(), buckets.end(),
+      [](const SkipBucket& b) { return b.src.empty(); }),
+    buckets.end());
+
+  for (auto& b: buckets) {
+    b.log_q = b.p_max >= 1 ? -std::numeric_limits<double>::infinity() : std::log1p(-b.p_max);
+    if (b.uniform) vector<float>().swap(b.probs);
+  }
+}
+
+void Sampler::sample_packed(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& sample,
+    datatypes::SampleScratch& scratch,
+    datatypes::PackedCover& packed) const {
+
+  sample_components(seed, sample, scratch);
+  packed.pack(scratch, encoding == CoverEncoding::sparse);
 }
 
-std::unique_ptr<datatypes::Graph> sample_graph(
-    const std::unique_ptr<datatypes::GraphByEdges>& graph_by_edges,
-    const std::unique_ptr<std::vector<datatypes::Node>>& nodes,
-    const std::unique_ptr<util::Dice> &dice) {
+void Sampler::sample_packed_range(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& first_sample,
+    const datatypes::LInt& count,
+    datatypes::SampleScratch& scratch,
+    datatypes::PackedCover* packed) const {
 
-  auto graph = make_unique<Graph>(nodes);
-  auto& sg_nodes = graph->nodes;
+  if (mode != SamplingMode::bitpar) {
+    for (LInt j = 0; j < count; j++) sample_packed(seed, first_sample + j, scratch, packed[j]);
+    return;
+  }
+
+  auto n = num_nodes();
+  auto& csr = *(graph_edges->edges);
+  auto& dsets = scratch.dsets;
+  auto& live = scratch.lane_edges;
+  live.resize(64);
+
+  auto last_sample = first_sample + count;
+  for (LInt b = first_sample >> 6; (b << 6) < last_sample; b++) {
+    auto lo = std::max(first_sample, b << 6);
+    auto hi = std::min(last_sample, (b + 1) << 6);
+    auto lanes = (hi - lo == 64 ? ~std::uint64_t(0) : ((std::uint64_t(1) << (hi - lo)) - 1))
+      << (lo & 63);
+
+    // one pass over the edges buckets the live ones by world.
+    auto gen = util::Philox(seed, b);
+    for (auto& l: live) l.clear();
+    for (LInt u = 0; u < n; u++) {
+      for (LInt e = csr.offsets[u]; e < csr.offsets[u + 1]; e++) {
+        auto mask = _live_lanes(gen, e, csr.probs[e], lanes);
+        while (mask != 0) {
+          live[__builtin_ctzll(mask)].emplace_back(u, csr.targets[e]);
+          mask &= mask - 1;
+        }
+      }
+    }
 
-  for (auto e: *(graph_by_edges->edges)) {
-    LInt u, v;
-    double a;
-    std::tie(u, v, a) = e;
-    if (dice->roll() < a) {
-      sg_nodes->at(u).neighbors.push_back(&(sg_nodes->at(v)));
-      sg_nodes->at(v).neighbors.push_back(&(sg_nodes->at(u)));
+    for (auto s = lo; s < hi; s++) {
+      if (dsets.parent.size() != (size_t)n) dsets = DisjointSets(n);
+      else dsets.reset();
+      for (auto& uv: live[s & 63]) dsets.unite(uv.first, uv.second);
+      packed[s - first_sample].pack(scratch, encoding == CoverEncoding::sparse);
     }
   }
+}
+
+void Sampler::sample_packed_levels(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& first_sample,
+    const datatypes::LInt& count,
+    const std::vector<float>& levels,
+    datatypes::SampleScratch& scratch,
+    const std::vector<datatypes::PackedCover*>& packed) const {
 
-  return graph;
+  if (mode != SamplingMode::edge) {
+    throw std::invalid_argument("activation levels need edge sampling");
+  }
+  for (LInt j = 0; j < count; j++) {
+    sample_components(seed, first_sample + j, scratch, &levels, packed.data(), j);
+  }
 }
 
-std::unique_ptr<std::vector<std::unique_ptr<datatypes::ConnectedComp>>> connected_component(
-    std::unique_ptr<datatypes::Graph>& graph) {
+void Sampler::sample_components(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& sample,
+    datatypes::SampleScratch& scratch,
+    const std::vector<float>* levels,
+    datatypes::PackedCover* const* packed,
+    const datatypes::LInt& offset) const {
 
-  auto ccs = make_unique<vector<unique_ptr<ConnectedComp>>>();
+  auto n = num_nodes();
+  auto& dsets = scratch.dsets;
+  if (dsets.parent.size() != (size_t)n) dsets = DisjointSets(n);
+  else dsets.reset();
 
-  std::for_each(graph->nodes->begin(), graph->nodes->end(), [&ccs](Node& u){
-    if (u.ccomp == nullptr) {
-      // auto& cc = ccs->emplace_back(make_unique<ConnectedComp>(u));
-      // u.ccomp = cc.get();
-      // code below for old g++ 5.2 on UH cluster...
-      std::unique_ptr<ConnectedComp> cc (new ConnectedComp(u));
-      u.ccomp = cc.get();
-      ccs->emplace_back(std::move(cc));
+  if (mode == SamplingMode::edge) {
+    // mc: word e of stream (seed, sample) for edge e. antithetic: for an odd sample, the
+    // complements of the draws of sample - 1. stratified: sample j of group k
+    // draws from stream strata_stream + k. selected a chunk of edges at a time.
+    const LInt chunk = 1024;
+    VInt live[chunk];
+    std::uint64_t stream = sample;
+    auto draw = EdgeDraw{0, false, 0};
+    if (design == SampleDesign::antithetic) {
+      stream = sample & ~LInt(1);
+      draw.flip = (sample & 1) ? ~std::uint32_t(0) : 0;
+    } else if (design == SampleDesign::stratified) {
+      stream = strata_stream + sample / num_strata;
+      draw = EdgeDraw{0, true, static_cast<std::uint32_t>(sample % num_strata)};
     }
-    for (auto v: u.neighbors) {
-      if (v->ccomp == nullptr) {
-        u.ccomp->add(*v);
-        v->ccomp = u.ccomp;
+    auto gen = util::Philox(seed, stream);
+    auto kernel = _live_edge_kernel();
+    auto& csr = *(graph_edges->edges);
+    LInt m = csr.num_edges();
+    auto& by_level = scratch.level_edges;
+    if (levels != nullptr) {
+      by_level.resize(levels->size());
+      for (auto& b: by_level) b.clear();
+    }
+    for (LInt begin = 0; begin < m; begin += chunk) {
+      auto count = kernel(
+        gen, draw, csr.probs.data(), begin, std::min(m, begin + chunk), live);
+      for (LInt k = 0; k < count; k++) {
+        auto e = begin + live[k];
+        if (levels == nullptr) {
+          dsets.unite(sources[e], csr.targets[e]);
+          continue;
+        }
+        // the lowest level the edge is live at, from its draw again.
+        auto u = util::Philox::to_float(draw(gen.block(e >> 2)[e & 3]));
+        auto l = std::upper_bound(levels->begin(), levels->end(), u) - levels->begin();
+        if (l < (LInt)levels->size()) by_level[l].push_back(e);
       }
     }
-  });
+    if (levels == nullptr) return;
+
+    for (size_t l = 0; l < levels->size(); l++) {
+      for (auto e: by_level[l]) dsets.unite(sources[e], csr.targets[e]);
+      packed[l][offset].pack(scratch, encoding == CoverEncoding::sparse);
+    }
+    return;
+  }
+
+  if (mode == SamplingMode::bitpar) {
+    // the one lane of sample's batch that belongs to it.
+    auto gen = util::Philox(seed, sample >> 6);
+    auto lane = std::uint64_t(1) << (sample & 63);
+    auto& csr = *(graph_edges->edges);
+    for (LInt u = 0; u < n; u++) {
+      for (LInt e = csr.offsets[u]; e < csr.offsets[u + 1]; e++) {
+        if (_live_lanes(gen, e, csr.probs[e], lane)) dsets.unite(u, csr.targets[e]);
+      }
+    }
+    return;
+  }
+
+  auto dice = util::CounterDice(seed, sample);
 
-  return ccs;
+  for (auto& b: buckets) {
+    LInt size = b.src.size();
+    LInt i = -1;
+    while (true) {
+      // number of failures before the next success, for success rate p_max.
+      auto skip = std::floor(std::log(1 - dice.roll()) / b.log_q);
+      if (skip >= size - i - 1) break;
+      i += 1 + static_cast<LInt>(skip);
+      if (b.uniform || dice.roll() * b.p_max < b.probs[i]) dsets.unite(b.src[i], b.dst[i]);
+    }
+  }
+}
+
+namespace {
+
+const char sample_store_magic[8] = {'P', 'I', 'N', 'F', 'S', 'M', 'P', 'L'};
+const std::uint32_t sample_store_version = 2;
+
+// the header a store file of these samples has.
+SampleStoreHeader _sample_store_key(
+    SamplingMode mode, CoverEncoding encoding, SampleDesign design,
+    const std::uint64_t& fingerprint, const GraphByEdges& graph_edges,
+    const LInt& seed, const LInt& first_sample, const LInt& count) {
+
+  SampleStoreHeader h;
+  std::memset(&h, 0, sizeof(h));
+  std::memcpy(h.magic, sample_store_magic, sizeof(h.magic));
+  h.version = sample_store_version;
+  h.mode = static_cast<std::uint32_t>(mode);
+  h.encoding = static_cast<std::uint32_t>(encoding);
+  h.design = static_cast<std::uint32_t>(design);
+  h.fingerprint = fingerprint;
+  h.num_nodes = graph_edges.num_nodes();
+  h.num_edges = graph_edges.edges->num_edges();
+  h.seed = seed;
+  h.first_sample = first_sample;
+  h.count = count;
+  return h;
+}
+
+std::string _sample_store_file(const std::string& dir, const SampleStoreHeader& key) {
+  std::ostringstream name;
+  name << dir << "/samples." << std::hex << key.fingerprint << "."
+    << std::hash<std::string>()(std::string(reinterpret_cast<const char*>(&key), sizeof(key)))
+    << ".v" << sample_store_version << ".bin";
+  return name.str();
 }
 
-std::unique_ptr<std::vector<datatypes::NodeIndexedCover>> get_cover(
-    std::unique_ptr<datatypes::Graph>& graph) {
+// FNV-1a over the bytes of an array.
+template <typename T>
+std::uint64_t _fnv1a(std::uint64_t h, const util::Array<T>& a) {
+  auto p = reinterpret_cast<const unsigned char*>(a.data());
+  for (size_t i = 0; i < a.size() * sizeof(T); i++) h = (h ^ p[i]) * 0x100000001B3;
+  return h;
+}
+
+// the samples of the store file at path, viewing it; nullptr unless it starts
+// with key and every entry lies within it and is the shape of a packed cover
+// of num_nodes nodes, so a corrupt file cannot make comp_at read past it.
+unique_ptr<vector<datatypes::PackedCover>> _map_sample_file(
+    const std::string& path, const SampleStoreHeader& key, const LInt& num_nodes) {
+
+  struct stat st;
+  if (stat(path.c_str(), &st) != 0) return nullptr;
 
-  auto niis = make_unique<vector<NodeIndexedCover>>();
-  niis->resize(graph->nodes->size());
+  auto file = std::make_shared<util::MappedFile>(path);
+  auto base = file->data();
+  size_t table = key.count * sizeof(SampleStoreEntry);
+  if (file->size() < _align8(sizeof(key)) + table) return nullptr;
+  if (std::memcmp(base, &key, sizeof(key)) != 0) return nullptr;
+  size_t entries_pos = file->size() - table;
 
-  for (auto& u: *(graph->nodes)) {
-    niis->at(u.id).cc_id = u.ccomp->id;
-    niis->at(u.id).cc_size = u.ccomp->size;
+  auto ret = make_unique<vector<datatypes::PackedCover>>(key.count);
+  for (LInt j = 0; j < key.count; j++) {
+    SampleStoreEntry x;
+    std::memcpy(&x, base + entries_pos + j * sizeof(x), sizeof(x));
+    if (x.words_pos < 0 || x.num_words < 0 || x.sizes_pos < 0 || x.num_sizes < 1 ||
+        x.listed_pos < 0 || x.num_listed < 0) return nullptr;
+    if ((size_t)x.words_pos + x.num_words * sizeof(std::uint64_t) > entries_pos ||
+        (size_t)x.sizes_pos + x.num_sizes * sizeof(VInt) > entries_pos ||
+        (size_t)x.listed_pos + x.num_listed * sizeof(VInt) > entries_pos) return nullptr;
+    // every index, implicit's too, is below num_sizes and fits in bits.
+    if (x.bits < 0 || x.bits > 32 || (x.sparse != 0 && x.sparse != 1)) return nullptr;
+    if (x.implicit < 0 || x.implicit >= x.num_sizes ||
+        (std::uint64_t)(x.num_sizes - 1) >> x.bits != 0) return nullptr;
+    LInt num_slots = x.sparse ? x.num_listed : num_nodes;
+    if (x.num_listed > (x.sparse ? num_nodes : 0)) return nullptr;
+    if (x.num_words < (num_slots * x.bits + 63) / 64) return nullptr;
+
+    auto& p = (*ret)[j];
+    p.words = util::Array<std::uint64_t>(
+      reinterpret_cast<const std::uint64_t*>(base + x.words_pos), x.num_words);
+    p.sizes = util::Array<VInt>(reinterpret_cast<const VInt*>(base + x.sizes_pos), x.num_sizes);
+    p.listed = util::Array<VInt>(
+      reinterpret_cast<const VInt*>(base + x.listed_pos), x.num_listed);
+    p.mapping = file;
+    p.num_nodes = num_nodes;
+    p.bits = x.bits;
+    p.sparse = x.sparse;
+    p.implicit = x.implicit;
   }
+  return ret;
+}
 
-  return niis;
 }
 
+void Sampler::set_store(const std::string& dir) {
+  store_dir = dir;
+  if (dir.empty()) return;
+  auto& csr = *(graph_edges->edges);
+  fingerprint = 0xCBF29CE484222325;
+  fingerprint = _fnv1a(fingerprint, csr.offsets);
+  fingerprint = _fnv1a(fingerprint, csr.targets);
+  fingerprint = _fnv1a(fingerprint, csr.probs);
+}
+
+// the file name hashes the header, which the file has to match in full.
+std::unique_ptr<std::vector<datatypes::PackedCover>> Sampler::load_samples(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& first_sample,
+    const datatypes::LInt& count) const {
+
+  if (store_dir.empty()) return nullptr;
+  auto key = _sample_store_key(
+    mode, encoding, design, fingerprint, *graph_edges, seed, first_sample, count);
+  return _map_sample_file(_sample_store_file(store_dir, key), key, num_nodes());
+}
+
+void Sampler::store_samples(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& first_sample,
+    const std::vector<datatypes::PackedCover>& packed) const {
+
+  if (store_dir.empty()) return;
+  auto file = SampleFile(*this, seed, first_sample, packed.size());
+  file.append(packed);
+  file.finish();
+}
+
+// a store file is written to a temporary name and renamed, as the graph cache
+// is, so concurrent runs never map a partial file.
+SampleFile::SampleFile(
+    const Sampler& sampler,
+    const datatypes::LInt& seed,
+    const datatypes::LInt& first_sample,
+    const datatypes::LInt& count,
+    const bool& stored) :
+  sampler(sampler), out(nullptr), pos(0) {
+
+  key = _sample_store_key(
+    sampler.mode, sampler.encoding, sampler.design, sampler.fingerprint, *sampler.graph(),
+    seed, first_sample, count);
+  entries.reserve(count);
+
+  if (stored && !sampler.store_dir.empty()) {
+    path = _sample_store_file(sampler.store_dir, key);
+    tmp_path = path + ".tmp." + std::to_string(getpid());
+    out = std::fopen(tmp_path.c_str(), "wb");
+  } else {
+    auto tmp_dir = std::getenv("TMPDIR");
+    tmp_path = std::string(tmp_dir != nullptr ? tmp_dir : "/tmp") + "/infl-spill.XXXXXX";
+    int fd = mkstemp(&tmp_path[0]);
+    if (fd >= 0) out = fdopen(fd, "wb");
+    path = tmp_path;
+  }
+  if (out != nullptr) put(&key, sizeof(key));
+}
+
+SampleFile::~SampleFile() {
+  if (out == nullptr) return;
+  std::fclose(out);
+  std::remove(tmp_path.c_str());
+}
+
+void SampleFile::put(const void* p, size_t len) {
+  static const char zeros[8] = {0};
+  if (len == 0) return;
+  std::fwrite(zeros, 1, _align8(pos) - pos, out);
+  pos = _align8(pos);
+  std::fwrite(p, 1, len, out);
+  pos += len;
+}
+
+void SampleFile::append(const std::vector<datatypes::PackedCover>& packed) {
+  if (out == nullptr) return;
+  for (auto& p: packed) {
+    SampleStoreEntry x;
+    x.words_pos = _align8(pos);
+    x.num_words = p.words.size();
+    put(p.words.data(), x.num_words * sizeof(std::uint64_t));
+    x.sizes_pos = _align8(pos);
+    x.num_sizes = p.sizes.size();
+    put(p.sizes.data(), x.num_sizes * sizeof(VInt));
+    x.listed_pos = _align8(pos);
+    x.num_listed = p.listed.size();
+    put(p.listed.data(), x.num_listed * sizeof(VInt));
+    x.implicit = p.implicit;
+    x.bits = p.bits;
+    x.sparse = p.sparse;
+    entries.push_back(x);
+  }
+}
+
+std::unique_ptr<std::vector<datatypes::PackedCover>> SampleFile::finish() {
+  if (out == nullptr) return nullptr;
+  put(entries.data(), entries.size() * sizeof(SampleStoreEntry));
+
+  bool ok = ((LInt)entries.size() == key.count) && (std::ferror(out) == 0);
+  ok = (std::fclose(out) == 0) && ok;
+  out = nullptr;
+  if (ok && path != tmp_path) ok = (std::rename(tmp_path.c_str(), path.c_str()) == 0);
+  if (!ok) {
+    std::remove(tmp_path.c_str());
+    return nullptr;
+  }
+
+  auto ret = _map_sample_file(path, key, sampler.num_nodes());
+  if (path == tmp_path) std::remove(path.c_str());
+  return ret;
+}
+
+RRSampler::RRSampler(const std::unique_ptr<datatypes::GraphByEdges>& graph_edges) :
+  graph_edges(graph_edges) {
+
+  auto& csr = *(graph_edges->edges);
+  auto n = csr.num_nodes();
+
+  offsets.assign(n + 1, 0);
+  for (LInt u = 0; u < n; u++) {
+    for (LInt e = csr.offsets[u]; e < csr.offsets[u + 1]; e++) {
+      offsets[u + 1]++;
+      offsets[csr.targets[e] + 1]++;
+    }
+  }
+  std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+
+  auto fill = vector<LInt>(offsets.begin(), offsets.end() - 1);
+  neighbors.resize(offsets[n]);
+  edge_ids.resize(offsets[n]);
+  for (LInt u = 0; u < n; u++) {
+    for (LInt e = csr.offsets[u]; e < csr.offsets[u + 1]; e++) {
+      auto v = csr.targets[e];
+      neighbors[fill[u]] = v;
+      edge_ids[fill[u]++] = e;
+      neighbors[fill[v]] = u;
+      edge_ids[fill[v]++] = e;
+    }
+  }
+}
+
+void RRSampler::sample(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& sample,
+    std::vector<char>& visited,
+    std::vector<datatypes::VInt>& nodes) const {
+
+  auto gen = util::Philox(seed, sample);
+  auto& probs = graph_edges->edges->probs;
+  auto n = num_nodes();
+
+  // the root's draw sits far past the blocks the edges use.
+  auto r = gen.block(std::uint64_t(1) << 62);
+  VInt root = std::min<LInt>(n - 1, util::Philox::to_double(r[0], r[1]) * n);
+
+  size_t head = nodes.size();
+  nodes.push_back(root);
+  visited[root] = 1;
+  for (size_t q = head; q < nodes.size(); q++) {
+    auto u = nodes[q];
+    for (LInt k = offsets[u]; k < offsets[u + 1]; k++) {
+      auto v = neighbors[k];
+      if (visited[v]) continue;
+
+      auto e = edge_ids[k];
+      if (util::Philox::to_float(gen.block(e >> 2)[e & 3]) < probs[e]) {
+        visited[v] = 1;
+        nodes.push_back(v);
+      }
+    }
+  }
+
+  for (size_t q = head; q < nodes.size(); q++) visited[nodes[q]] = 0;
+}
+
+// a singleton is keyed by its node rather than the shared index 0, so that
+// every distinct node is counted.
 LInt calculate_cover(
     std::unique_ptr<std::vector<LInt>>& nodes,
-    std::unique_ptr<std::vector<datatypes::NodeIndexedCover>>& covers) {
+    const datatypes::PackedCover& cover) {
 
   auto covered = set<LInt>();
   LInt sum = 0;
 
   for (auto& id: *nodes) {
-    auto iter_bool = covered.insert(covers->at(id).cc_id);
-    if (iter_bool.second == true) sum += covers->at(id).cc_size;
+    auto c = cover.comp(id);
+    auto iter_bool = covered.insert(c == 0 ? -id - 1 : (LInt)c);
+    if (iter_bool.second == true) sum += cover.sizes[c];
   }
 
   return sum;
@@ -182,17 +1059,18 @@ LInt calculate_cover(
 
 std::unique_ptr<std::vector<datatypes::LInt>> calculate_accumulative_cover(
     std::unique_ptr<std::vector<datatypes::LInt>>& nodes,
-    std::unique_ptr<std::vector<datatypes::NodeIndexedCover>>& covers) {
+    const datatypes::PackedCover& cover) {
 
   auto ret = make_unique<vector<LInt>>();
   ret->resize(nodes->size());
-  auto cover = set<LInt>();
+  auto covered = set<LInt>();
   LInt sum = 0;
 
   for (size_t i = 0; i < nodes->size(); i++) {
     auto& id = nodes->at(i);
-    auto iter_bool = cover.insert(covers->at(id).cc_id);
-    if (iter_bool.second == true) sum += covers->at(id).cc_size;
+    auto c = cover.comp(id);
+    auto iter_bool = covered.insert(c == 0 ? -id - 1 : (LInt)c);
+    if (iter_bool.second == true) sum += cover.sizes[c];
 
     ret->at(i) = sum;
   }
@@ -202,8 +1080,7 @@ std::unique_ptr<std::vector<datatypes::LInt>> calculate_accumulative_cover(
 
 std::unique_ptr<std::vector<datatypes::LInt>> calculate_accumulative_average_cover(
     std::unique_ptr<std::vector<datatypes::LInt>>& nodes,
-    std::unique_ptr<std::vector<
-      std::unique_ptr<std::vector<datatypes::NodeIndexedCover>>>>& covers) {
+    std::unique_ptr<std::vector<datatypes::PackedCover>>& covers) {
 
   auto ret = make_unique<vector<LInt>>(nodes->size(), 0);
 
@@ -222,8 +1099,7 @@ std::unique_ptr<std::vector<datatypes::LInt>> calculate_accumulative_average_cov
 
 std::unique_ptr<std::vector<datatypes::LInt>> calculate_total_cover_per_sample(
     std::unique_ptr<std::vector<datatypes::LInt>>& nodes,
-    std::unique_ptr<std::vector<
-      std::unique_ptr<std::vector<datatypes::NodeIndexedCover>>>>& covers) {
+    std::unique_ptr<std::vector<datatypes::PackedCover>>& covers) {
 
   auto ret = make_unique<vector<LInt>>();
 
@@ -2,49 +2,288 @@
 #define GRAPH_H
 
 #include <memory>
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstdint>
 #include "datatypes.h"
 #include "util.h"
 
 namespace graph {
 
+// vertexes get dense internal ids in order of first appearance, and the edges
+// are stored as a CSR adjacency.
 std::unique_ptr<datatypes::GraphByEdges> read_edges(
   const std::string &fname, const double &activation, const int &seed);
 
-std::unique_ptr<std::vector<datatypes::Node>> get_graph_nodes(
-  const std::unique_ptr<datatypes::GraphByEdges>& graph_edges);
+// like read_edges, but keeps the processed graph in a versioned binary file under
+// cache_dir, keyed on the input path, its mtime, activation and seed. a later
+// call with the same key maps that file read-only instead of parsing the text.
+std::unique_ptr<datatypes::GraphByEdges> read_edges_cached(
+  const std::string &fname, const double &activation, const int &seed,
+  const std::string &cache_dir);
 
-std::unique_ptr<datatypes::Graph> sample_graph(
-  const std::unique_ptr<datatypes::GraphByEdges>& graph_edges,
-  const std::unique_ptr<std::vector<datatypes::Node>>& graph_nodes,
-  const std::unique_ptr<util::Dice> &dice);
+enum class SamplingMode { edge, skip, bitpar };
 
-// return a unique_ptr, which must have the same lifespan with the input Graph.
-// update the Graph nodes pointers to their ConnectedComp.
-std::unique_ptr<std::vector<std::unique_ptr<datatypes::ConnectedComp>>> connected_component(
-  std::unique_ptr<datatypes::Graph>& graph);
+// parses "edge", "skip" or "bitpar"; throws std::invalid_argument otherwise.
+SamplingMode parse_sampling_mode(const std::string &name);
 
-// return a compact representation, indexed by Node Id.
-// after this function returns, it is safe to destroy the Graph and the ConnectedComp vector.
-std::unique_ptr<std::vector<datatypes::NodeIndexedCover>> get_cover(
-  std::unique_ptr<datatypes::Graph>& graph);
+enum class CoverEncoding { dense, sparse };
+
+// parses "dense" or "sparse"; throws std::invalid_argument otherwise.
+CoverEncoding parse_cover_encoding(const std::string &name);
+
+// how the samples of an edge-mode Sampler relate to each other. mc: all
+// independent. antithetic: samples 2k and 2k + 1 draw complementary uniforms
+// for every edge. stratified: over each aligned group of group_size() samples,
+// every edge's uniform falls once in each of group_size() equal strata of
+// [0, 1), in an order of its own (a Latin hypercube per group). every sample
+// on its own is drawn from the live-edge model, and different groups are
+// independent.
+enum class SampleDesign { mc, antithetic, stratified };
+
+// parses "mc", "antithetic" or "stratified"; throws std::invalid_argument otherwise.
+SampleDesign parse_sample_design(const std::string &name);
+
+// a sample-store file: this header, then the words, sizes and listed nodes of
+// every sample in turn, each section starting on an 8-byte boundary, and last
+// a table of one entry per sample, so a file can be written block by block.
+struct SampleStoreHeader {
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t mode;
+  std::uint32_t encoding;
+  std::uint32_t design;
+  std::uint64_t fingerprint;
+  std::int64_t num_nodes;
+  std::int64_t num_edges;
+  std::int64_t seed;
+  std::int64_t first_sample;
+  std::int64_t count;
+};
+
+// where a sample's arrays start in the file, and how long they are.
+struct SampleStoreEntry {
+  std::int64_t words_pos;
+  std::int64_t num_words;
+  std::int64_t sizes_pos;
+  std::int64_t num_sizes;
+  std::int64_t listed_pos;
+  std::int64_t num_listed;
+  std::int64_t implicit;
+  std::int32_t bits;
+  std::int32_t sparse;
+};
+
+// draws live-edge samples of a graph in the given mode. every sample is keyed on
+// (seed, sample index) only, so it is the same whichever thread draws it.
+// edge: one draw per edge, in CSR order: edge e of sample s is live when word e
+// of the Philox stream (seed, s) is below its activation. the draws and
+// comparisons run 32 edges at a time with AVX2 where the CPU has it.
+// skip: edges are grouped by activation into buckets whose probabilities are
+// within a factor of 2; the next live candidate in a bucket is reached with a
+// geometric skip at the bucket maximum and kept with probability p / p_max, so
+// the rolls per sample scale with the number of live edges instead of m.
+// bitpar: samples come in aligned batches of 64 that share one pass over the
+// edges, each edge drawing a 64-bit mask of the worlds it is live in.
+// packed samples are stored in the given encoding (see PackedCover), and edge
+// mode draws them in the given design; the other modes only draw mc samples.
+class Sampler {
+public:
+  Sampler(
+    const std::unique_ptr<datatypes::GraphByEdges>& graph_edges,
+    SamplingMode mode,
+    CoverEncoding encoding = CoverEncoding::dense,
+    SampleDesign design = SampleDesign::mc);
+
+  Sampler (const Sampler&) = delete;
+  Sampler& operator= (const Sampler&) = delete;
+
+  inline const std::unique_ptr<datatypes::GraphByEdges>& graph() const { return graph_edges; }
+  inline datatypes::LInt num_nodes() const { return graph_edges->num_nodes(); }
+
+  // samples k * batch_size() .. (k + 1) * batch_size() - 1 are drawn together
+  // by sample_packed_range; drawing one of them alone costs about as much.
+  inline datatypes::LInt batch_size() const { return mode == SamplingMode::bitpar ? 64 : 1; }
+
+  // samples k * group_size() .. (k + 1) * group_size() - 1 are drawn jointly
+  // by the design, and independently of every other group.
+  inline datatypes::LInt group_size() const {
+    if (design == SampleDesign::antithetic) return 2;
+    return design == SampleDesign::stratified ? num_strata : 1;
+  }
+
+  // sample `sample` of the seed stream, labeled by component and packed.
+  void sample_packed(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& sample,
+    datatypes::SampleScratch& scratch,
+    datatypes::PackedCover& packed) const;
+
+  // samples first_sample .. first_sample + count - 1 into packed[0 .. count - 1].
+  void sample_packed_range(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& first_sample,
+    const datatypes::LInt& count,
+    datatypes::SampleScratch& scratch,
+    datatypes::PackedCover* packed) const;
+
+  // the same samples at every activation in levels, ascending and none above
+  // an edge's own probability, into packed[l][0 .. count - 1]: an edge is live
+  // at level l when its draw is below levels[l], so the samples of level l are
+  // those of the graph read with uniform activation levels[l], and each world
+  // grows with the level. one pass of draws serves every level, whose edges
+  // are united in order, packing after each. edge mode only.
+  void sample_packed_levels(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& first_sample,
+    const datatypes::LInt& count,
+    const std::vector<float>& levels,
+    datatypes::SampleScratch& scratch,
+    const std::vector<datatypes::PackedCover*>& packed) const;
+
+  // keeps packed samples in versioned files under dir, keyed on a fingerprint
+  // of the graph, the sampling mode, encoding and design, the seed and the
+  // range of samples, for later runs to map read-only instead of drawing them
+  // again; concurrent runs on one machine share them through the page cache.
+  void set_store(const std::string& dir);
+
+  // samples first_sample .. first_sample + count - 1 of seed as stored, viewing
+  // the mapped file; nullptr without a store or a file for them.
+  std::unique_ptr<std::vector<datatypes::PackedCover>> load_samples(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& first_sample,
+    const datatypes::LInt& count) const;
+
+  // stores packed as samples first_sample .. of seed; nothing without a store.
+  void store_samples(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& first_sample,
+    const std::vector<datatypes::PackedCover>& packed) const;
+
+  // with a budget, a shared collection that would take more bytes than it is
+  // drawn a block at a time into a SampleFile and mapped back, so the kernel
+  // can page it out instead of the process running out of memory. 0 for none.
+  inline void set_mem_budget(const datatypes::LInt& bytes) { budget = bytes; }
+  inline datatypes::LInt mem_budget() const { return budget; }
+
+private:
+  // leaves the components of the sample in scratch.dsets. with levels, edge mode
+  // packs the sample at every level into packed[l][offset] instead.
+  void sample_components(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& sample,
+    datatypes::SampleScratch& scratch,
+    const std::vector<float>* levels = nullptr,
+    datatypes::PackedCover* const* packed = nullptr,
+    const datatypes::LInt& offset = 0) const;
+
+  struct SkipBucket {
+    float p_max;
+    double log_q;  // log(1 - p_max)
+    bool uniform;  // every edge has p_max, no thinning needed
+    std::vector<datatypes::VInt> src;
+    std::vector<datatypes::VInt> dst;
+    std::vector<float> probs;
+  };
+
+  // stratified group k draws from Philox stream strata_stream + k, clear of
+  // the streams of the samples themselves.
+  static constexpr datatypes::LInt num_strata = 32;
+  static constexpr std::uint64_t strata_stream = std::uint64_t(1) << 61;
+
+  const std::unique_ptr<datatypes::GraphByEdges>& graph_edges;
+  SamplingMode mode;
+  CoverEncoding encoding;
+  SampleDesign design;
+  std::string store_dir;
+  std::uint64_t fingerprint;
+  datatypes::LInt budget;
+  std::vector<datatypes::VInt> sources;  // edge: the source of every CSR edge
+  std::vector<SkipBucket> buckets;
+
+  friend class SampleFile;
+};
+
+// a sample-store file written a block of samples at a time, in order, then
+// mapped back: into the sampler's store if stored and it has one, otherwise
+// into a temporary file under $TMPDIR that is gone once unmapped.
+class SampleFile {
+public:
+  SampleFile(
+    const Sampler& sampler,
+    const datatypes::LInt& seed,
+    const datatypes::LInt& first_sample,
+    const datatypes::LInt& count,
+    const bool& stored = true);
+  ~SampleFile();
+
+  SampleFile (const SampleFile&) = delete;
+  SampleFile& operator= (const SampleFile&) = delete;
+
+  // writes packed as the next samples.
+  void append(const std::vector<datatypes::PackedCover>& packed);
+
+  // all count samples, viewing the file; nullptr if it could not be written.
+  std::unique_ptr<std::vector<datatypes::PackedCover>> finish();
+
+private:
+  void put(const void* p, size_t len);
+
+  const Sampler& sampler;
+  SampleStoreHeader key;
+  std::string path;
+  std::string tmp_path;
+  std::FILE* out;
+  size_t pos;
+  std::vector<SampleStoreEntry> entries;
+};
+
+// reverse-reachable sets for the undirected live-edge model, where the nodes
+// that reach a root are just its component. set j is the component of a
+// random root in edge-mode sample j of the seed stream: it is explored
+// breadth-first from the root over both directions of every edge, and an edge
+// is drawn, with the same Philox word as in Sampler's edge mode, only when the
+// search reaches it.
+class RRSampler {
+public:
+  RRSampler(const std::unique_ptr<datatypes::GraphByEdges>& graph_edges);
+
+  RRSampler (const RRSampler&) = delete;
+  RRSampler& operator= (const RRSampler&) = delete;
+
+  inline datatypes::LInt num_nodes() const { return graph_edges->num_nodes(); }
+
+  // appends set `sample` to nodes. visited is scratch of num_nodes() zeros,
+  // and is left that way.
+  void sample(
+    const datatypes::LInt& seed,
+    const datatypes::LInt& sample,
+    std::vector<char>& visited,
+    std::vector<datatypes::VInt>& nodes) const;
+
+private:
+  const std::unique_ptr<datatypes::GraphByEdges>& graph_edges;
+  std::vector<datatypes::LInt> offsets;
+  std::vector<datatypes::VInt> neighbors;
+  std::vector<datatypes::LInt> edge_ids;  // the CSR edge behind each neighbor
+};
 
 datatypes::LInt calculate_cover(
   std::unique_ptr<std::vector<datatypes::LInt>>& nodes,
-  std::unique_ptr<std::vector<datatypes::NodeIndexedCover>>& covers);
+  const datatypes::PackedCover& cover);
 
 std::unique_ptr<std::vector<datatypes::LInt>> calculate_accumulative_cover(
   std::unique_ptr<std::vector<datatypes::LInt>>& nodes,
-  std::unique_ptr<std::vector<datatypes::NodeIndexedCover>>& covers);
+  const datatypes::PackedCover& cover);
 
 std::unique_ptr<std::vector<datatypes::LInt>> calculate_accumulative_average_cover(
   std::unique_ptr<std::vector<datatypes::LInt>>& nodes,
-  std::unique_ptr<std::vector<
-      std::unique_ptr<std::vector<datatypes::NodeIndexedCover>>>>& covers);
+  std::unique_ptr<std::vector<datatypes::PackedCover>>& covers);
 
 std::unique_ptr<std::vector<datatypes::LInt>> calculate_total_cover_per_sample(
   std::unique_ptr<std::vector<datatypes::LInt>>& nodes,
-  std::unique_ptr<std::vector<
-      std::unique_ptr<std::vector<datatypes::NodeIndexedCover>>>>& covers);
+  std::unique_ptr<std::vector<datatypes::PackedCover>>& covers);
 
 }
 
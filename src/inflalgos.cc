@@ -3,6 +3,14 @@
 #include <set>
 #include <algorithm>
 #include <cmath>
+#include <functional>
+#include <numeric>
+#include <limits>
+#include <string>
+#include <stdexcept>
+#include <exception>
+#include <atomic>
+#include <omp.h>
 #include "datatypes.h"
 #include "graph.h"
 #include "util.h"
@@ -14,211 +22,1043 @@ using std::unique_ptr;
 using std::make_unique;
 using std::vector;
 using std::set;
-using util::Dice;
-using util::STDice;
 using datatypes::NodeMeasure;
-using datatypes::Node;
-using datatypes::Graph;
 using datatypes::GraphByEdges;
-using datatypes::NodeIndexedCover;
+using datatypes::PackedCover;
+using datatypes::VInt;
 using datatypes::LInt;
 using datatypes::Bicriteria;
 
-void _update_node_measure(
-    unique_ptr<vector<LInt>>& node_indexed_measure,
-    const unique_ptr<vector<NodeIndexedCover>>& nics,
-    const unique_ptr<set<LInt>>& base_nodeids) {
+using CompactSampleCollection = unique_ptr<vector<PackedCover>>;
+
+ThreadUtilization _utilization;
+
+// a number for the OS thread that runs it, the same in every team the
+// thread joins, nested ones too, where omp_get_thread_num() restarts at 0.
+size_t _thread_slot() {
+  static std::atomic<size_t> next_slot(0);
+  thread_local size_t slot = next_slot++;
+  return slot;
+}
+
+// one run of a sample loop by a team: its threads' busy seconds, how many
+// there were and the longest one, which it adds to _utilization when it goes
+// out of scope, after the parallel region.
+struct SampleLoop {
+  double busy;
+  double longest;
+  int threads;
+
+  SampleLoop() : busy(0), longest(0), threads(0) {}
+
+  ~SampleLoop() {
+    #pragma omp critical(thread_utilization)
+    {
+      _utilization.loop_busy += busy;
+      _utilization.loop_span += threads * longest;
+    }
+  }
+};
+
+// one thread's share of a sample loop: stop() adds the samples it counted and
+// the seconds since it was made to _utilization, under the thread's slot, and
+// to the loop. the loops end in nowait and stop before any barrier, so
+// waiting for the other threads is not counted as busy.
+struct LoopTimer {
+  SampleLoop& loop;
+  double start;
+  LInt samples;
+
+  LoopTimer(SampleLoop& loop) : loop(loop), start(omp_get_wtime()), samples(0) {}
+
+  void stop() {
+    double busy = omp_get_wtime() - start;
+    size_t t = _thread_slot();
+    #pragma omp critical(thread_utilization)
+    {
+      if (_utilization.samples.size() <= t) {
+        _utilization.samples.resize(t + 1, 0);
+        _utilization.busy.resize(t + 1, 0);
+      }
+      _utilization.samples[t] += samples;
+      _utilization.busy[t] += busy;
+      loop.busy += busy;
+      loop.longest = std::max(loop.longest, busy);
+      loop.threads++;
+    }
+  }
+};
+
+// raises omp's max active levels to at least levels, for nested teams, while
+// it lives, and puts back what they were; the setting is process-wide.
+struct NestedLevels {
+  int saved;
+
+  NestedLevels(int levels) : saved(omp_get_max_active_levels()) {
+    if (saved < levels) omp_set_max_active_levels(levels);
+  }
+  ~NestedLevels() { omp_set_max_active_levels(saved); }
+};
+
+// the threads that ran a sample loop since the last reset, in slot order.
+ThreadUtilization thread_utilization() {
+  auto ret = _utilization;
+  ret.samples.clear();
+  ret.busy.clear();
+  for (size_t t = 0; t < _utilization.busy.size(); t++) {
+    if (_utilization.busy[t] == 0 && _utilization.samples[t] == 0) continue;
+    ret.samples.push_back(_utilization.samples[t]);
+    ret.busy.push_back(_utilization.busy[t]);
+  }
+  return ret;
+}
 
-  auto base_ccids = set<LInt>();
-  for (auto& u: *base_nodeids) {
-    base_ccids.insert(nics->at(u).cc_id);
+void reset_thread_utilization() { _utilization = ThreadUtilization(); }
+
+// component table of one sample against a seed set. every node of a component
+// has the same marginal gain, so it is computed once per component index:
+// gain[c] is the component size, or 0 if a seed already covers it. covered
+// components are stamped with the current epoch, so moving on to the next sample
+// is ++epoch rather than clearing anything. the shared singleton index 0 always
+// gains 1 for a non-seed node.
+struct ComponentGains {
+  vector<LInt> stamp;
+  vector<LInt> gain;
+  LInt epoch;
+  LInt base_covered;
+
+  ComponentGains() : epoch(0), base_covered(0) {}
+
+  // makes room for the component indexes of n-node samples. the stamps left
+  // are all below the next epoch, so they need no clearing.
+  void fit(LInt n) {
+    if ((LInt)gain.size() < n / 2 + 1) {
+      stamp.resize(n / 2 + 1, 0);
+      gain.resize(n / 2 + 1, 0);
+    }
   }
 
-  for (size_t i = 0; i < node_indexed_measure->size(); i++) {
-    auto& m = node_indexed_measure->at(i);
+  void build(const PackedCover& cover, const set<LInt>& seeds) {
+    epoch++;
+    base_covered = 0;
+    for (auto& u: seeds) {
+      auto c = cover.comp(u);
+      if (c == 0) {
+        base_covered += 1;
+      } else if (stamp[c] != epoch) {
+        stamp[c] = epoch;
+        base_covered += cover.sizes[c];
+      }
+    }
 
-    auto ccid = nics->at(i).cc_id;
-    auto find = base_ccids.find(ccid);
+    gain[0] = 1;
+    for (LInt c = 1; c < cover.num_comps(); c++) {
+      gain[c] = (stamp[c] == epoch) ? 0 : cover.sizes[c];
+    }
+  }
 
-    if (find != base_ccids.end()) continue;
+  inline LInt of(const VInt& c) const { return gain[c]; }
 
-    m = nics->at(i).cc_size;
+  // the gain shared by the nodes a sparse cover leaves implicit; 0 for a dense
+  // cover, which has none.
+  inline LInt implicit_of(const PackedCover& cover) const {
+    return cover.sparse ? gain[cover.implicit] : 0;
+  }
+};
+
+struct NodeLoHiCount {
+  LInt id;
+  LInt lo, hi, count;
+
+  NodeLoHiCount() : id(0), lo(0), hi(0), count(0) {}
+
+  NodeLoHiCount(LInt id, LInt lo, LInt hi, LInt count) :
+    id(id), lo(lo), hi(hi), count(count) {}
+};
+
+// one thread's working memory, kept at its high-water mark and reused across
+// the samples and greedy steps of an algorithm call, so the kernels'
+// per-sample and per-node tables are allocated once per thread and call
+// rather than once per sample or step: what drawing samples needs, the covers
+// fresh samples are drawn into, and the kernels' tables. inside a kernel's
+// parallel region each thread works in its own; what the region shares (seed
+// flags, the seeds' covered components) lives in the calling thread's.
+struct ThreadScratch {
+  datatypes::SampleScratch sample;
+  vector<PackedCover> covers;  // SampleBuffer
+  ComponentGains gains;
+  vector<LInt> measure;  // a node-indexed sum
+  vector<NodeLoHiCount> node_lhcs;  // _prob_measures
+  vector<LInt> implicit_values;  // _prob_measures
+  vector<LInt> values;  // a block of nodes', or one node's, value in every sample
+  vector<char> is_seed;  // shared
+  vector<LInt> base_covered;  // shared, _quantile_measures
+  vector<vector<VInt>> base_ccids;  // shared, _quantile_measures
+};
+
+// the ThreadScratch of every OS thread that works for one algorithm call, made
+// the first time the thread asks and freed with the pool, which the call owns
+// and passes down. the tables thus last as long as the call, not the thread,
+// and nested teams, which may run on many more OS threads than num_threads,
+// leave nothing behind. a thread keeps a pointer to its scratch in the pool
+// it last used, so asking again takes no lock.
+struct ScratchPool {
+  std::uint64_t id;
+  vector<unique_ptr<ThreadScratch>> scratches;
+
+  ScratchPool() : id(next_id()) {}
+
+  ScratchPool (const ScratchPool&) = delete;
+  ScratchPool& operator= (const ScratchPool&) = delete;
+
+  ThreadScratch& get() {
+    thread_local std::uint64_t cached_id = 0;
+    thread_local ThreadScratch* cached = nullptr;
+    if (cached_id != id) {
+      auto scratch = make_unique<ThreadScratch>();
+      cached = scratch.get();
+      #pragma omp critical(scratch_pool)
+      scratches.push_back(std::move(scratch));
+      cached_id = id;
+    }
+    return *cached;
+  }
+
+  static std::uint64_t next_id() {
+    static std::atomic<std::uint64_t> last_id(0);
+    return ++last_id;
+  }
+};
+
+// grows covers to target samples: sample j of the collection is sample
+// first_sample + j of the rand_seed stream. the threads take the sampler's
+// batches whole.
+void _extend_samples_collection(
+    const graph::Sampler& sampler,
+    const int& rand_seed,
+    const LInt& first_sample,
+    const LInt& target,
+    const int& num_threads,
+    ScratchPool& pool,
+    vector<PackedCover>& covers) {
+
+  LInt old_size = covers.size();
+  if (target <= old_size) return;
+  covers.resize(target);
+
+  auto batch = sampler.batch_size();
+  auto lo_sample = first_sample + old_size;
+  auto hi_sample = first_sample + target;
+  LInt first_batch = lo_sample / batch;
+  LInt last_batch = (hi_sample + batch - 1) / batch;
+
+  auto loop = SampleLoop();
+  #pragma omp parallel num_threads(num_threads)
+  {
+    auto& scratch = pool.get().sample;
+    auto timer = LoopTimer(loop);
+
+    #pragma omp for schedule(dynamic) nowait
+    for (LInt b = first_batch; b < last_batch; b++) {
+      auto lo = std::max(lo_sample, b * batch);
+      auto hi = std::min(hi_sample, (b + 1) * batch);
+      sampler.sample_packed_range(rand_seed, lo, hi - lo, scratch, &covers[lo - first_sample]);
+      timer.samples += hi - lo;
+    }
+    timer.stop();
+  }
+}
+
+// the rest of a collection that is over the sampler's memory budget, drawn
+// block_size samples at a time, each block written to a graph::SampleFile and
+// dropped, after the covers already drawn; the file is then mapped back. if it
+// cannot be written, this throws std::runtime_error rather than draw the
+// collection whole in memory, the very thing the budget is there to stop.
+CompactSampleCollection _spill_samples_collection(
+    const graph::Sampler& sampler,
+    const int& rand_seed,
+    const LInt& first_sample,
+    const int& num_samples,
+    const int& num_threads,
+    ScratchPool& pool,
+    vector<PackedCover>& covers,
+    const LInt& block_size,
+    const bool& stored) {
+
+  auto file = graph::SampleFile(sampler, rand_seed, first_sample, num_samples, stored);
+  LInt done = covers.size();
+  file.append(covers);
+  while (done < num_samples) {
+    auto size = std::min<LInt>(block_size, num_samples - done);
+    covers.clear();
+    _extend_samples_collection(
+      sampler, rand_seed, first_sample + done, size, num_threads, pool, covers);
+    file.append(covers);
+    done += size;
+  }
+  covers.clear();
+
+  auto ret = file.finish();
+  if (!ret) {
+    throw std::runtime_error("cannot write " + std::to_string(num_samples) +
+      " samples over the memory budget to a file");
+  }
+  return ret;
+}
+
+CompactSampleCollection _get_samples_collection(
+    const graph::Sampler& sampler,
+    const int& rand_seed,
+    const LInt& first_sample,
+    const int& num_samples,
+    const int& num_threads,
+    ScratchPool& pool,
+    const bool& fresh = false) {
+
+  auto ret = fresh ? nullptr : sampler.load_samples(rand_seed, first_sample, num_samples);
+  if (ret) return ret;
+  ret = make_unique<vector<PackedCover>>();
+
+  // with a memory budget, a first block sizes the samples, and a collection
+  // that would not fit goes through a file, in blocks of half the budget.
+  LInt budget = sampler.mem_budget();
+  if (budget > 0) {
+    LInt batch = sampler.batch_size();
+    LInt first_block = std::min<LInt>(num_samples, std::max<LInt>(64, batch));
+    _extend_samples_collection(
+      sampler, rand_seed, first_sample, first_block, num_threads, pool, *ret);
+    size_t bytes = 0;
+    for (auto& p: *ret) bytes += p.bytes();
+    double per_sample = (double)bytes / first_block;
+    if (per_sample * num_samples > budget) {
+      LInt block_size = std::max<LInt>(1, budget / 2 / per_sample / batch) * batch;
+      return _spill_samples_collection(
+        sampler, rand_seed, first_sample, num_samples, num_threads, pool, *ret, block_size,
+        !fresh);
+    }
+  }
+
+  _extend_samples_collection(
+    sampler, rand_seed, first_sample, num_samples, num_threads, pool, *ret);
+  if (!fresh) sampler.store_samples(rand_seed, first_sample, *ret);
+  return ret;
+}
+
+CompactSampleCollection get_samples_collection(
+    const graph::Sampler& sampler,
+    const int& rand_seed,
+    const LInt& first_sample,
+    const int& num_samples,
+    const int& num_threads,
+    const bool& fresh) {
+
+  auto pool = ScratchPool();
+  return _get_samples_collection(
+    sampler, rand_seed, first_sample, num_samples, num_threads, pool, fresh);
+}
+
+// the collections of samples first_sample .. first_sample + num_samples - 1 of
+// the rand_seed stream at every activation in levels, drawn together; with no
+// levels, the one collection at the sampler's own activations.
+vector<CompactSampleCollection> _get_level_collections(
+    const graph::Sampler& sampler,
+    const vector<float>& levels,
+    const int& rand_seed,
+    const LInt& first_sample,
+    const int& num_samples,
+    const int& num_threads,
+    ScratchPool& pool) {
+
+  auto ret = vector<CompactSampleCollection>();
+  if (levels.empty()) {
+    ret.push_back(_get_samples_collection(
+      sampler, rand_seed, first_sample, num_samples, num_threads, pool));
+    return ret;
+  }
+
+  for (size_t l = 0; l < levels.size(); l++) {
+    ret.push_back(make_unique<vector<PackedCover>>(num_samples));
+  }
+
+  auto loop = SampleLoop();
+  #pragma omp parallel num_threads(num_threads)
+  {
+    auto& scratch = pool.get().sample;
+    auto packed = vector<PackedCover*>(levels.size());
+    auto timer = LoopTimer(loop);
+
+    #pragma omp for schedule(dynamic) nowait
+    for (LInt j = 0; j < num_samples; j++) {
+      for (size_t l = 0; l < levels.size(); l++) packed[l] = &(*ret[l])[j];
+      sampler.sample_packed_levels(rand_seed, first_sample + j, 1, levels, scratch, packed);
+      timer.samples++;
+    }
+    timer.stop();
+  }
+  return ret;
+}
+
+// the samples a thread drew last, a batch of the sampler at a time, limited to
+// the step's samples lo .. hi - 1.
+struct SampleBuffer {
+  vector<PackedCover>& covers;
+  LInt first, count;
+  LInt lo, hi;
+
+  SampleBuffer(vector<PackedCover>& covers, LInt lo, LInt hi) :
+    covers(covers), first(0), count(0), lo(lo), hi(hi) {}
+};
+
+// sample j of a greedy step: csc->at(j) when the step shares a collection,
+// otherwise sample first_sample + j of the rand_seed stream, drawn into buffer.
+inline const PackedCover& _get_sample(
+    const graph::Sampler& sampler,
+    const CompactSampleCollection* csc,
+    const int& rand_seed,
+    const LInt& sample,
+    datatypes::SampleScratch& scratch,
+    SampleBuffer& buffer) {
+
+  if (csc != nullptr) return (**csc)[sample];
+  if (sample < buffer.first || sample >= buffer.first + buffer.count) {
+    auto batch = sampler.batch_size();
+    auto b = sample / batch;
+    buffer.first = std::max(buffer.lo, b * batch);
+    buffer.count = std::min(buffer.hi, (b + 1) * batch) - buffer.first;
+    if ((LInt)buffer.covers.size() < batch) buffer.covers.resize(batch);
+    sampler.sample_packed_range(
+      rand_seed, buffer.first, buffer.count, scratch, buffer.covers.data());
+  }
+  return buffer.covers[sample - buffer.first];
+}
+
+// flags[u] is 1 for the seeds of the n nodes, 0 for the rest.
+const vector<char>& _seed_flags(vector<char>& flags, const LInt& n, const set<LInt>& seeds) {
+  flags.assign(n, 0);
+  for (auto& u: seeds) flags[u] = 1;
+  return flags;
+}
+
+// the components a seed set covers in each sample of a collection, kept as a
+// sorted list per sample so one node can be scored at a time: base[s] is the
+// seeds' coverage in sample s.
+struct SeedCovers {
+  const vector<PackedCover>& covers;
+  vector<vector<VInt>> comps;
+  vector<LInt> base;
+
+  SeedCovers(const vector<PackedCover>& covers) :
+    covers(covers), comps(covers.size()), base(covers.size(), 0) {}
+
+  void add(const LInt& u) {
+    for (size_t s = 0; s < covers.size(); s++) {
+      auto c = covers[s].comp(u);
+      if (c == 0) {
+        base[s] += 1;
+        continue;
+      }
+      auto it = std::lower_bound(comps[s].begin(), comps[s].end(), c);
+      if (it != comps[s].end() && *it == c) continue;
+      comps[s].insert(it, c);
+      base[s] += covers[s].sizes[c];
+    }
+  }
+
+  // what a node of component c, not itself a seed, adds in sample s.
+  inline LInt gain_of(const size_t& s, const VInt& c) const {
+    if (c != 0 && std::binary_search(comps[s].begin(), comps[s].end(), c)) return 0;
+    return covers[s].sizes[c];
+  }
+
+  inline LInt gain(const size_t& s, const LInt& v) const { return gain_of(s, covers[s].comp(v)); }
+};
+
+// CELF: the candidate of highest score, ties to the smallest id, scoring as
+// few nodes as it can. bounds[v] must be at least v's score. candidates are taken
+// in order of their bounds, num_threads at a time, and are scored in parallel;
+// the search stops once no bound left can beat the best score found. scoring
+// one node is dearer than its share of a bulk pass, so once more than a
+// quarter of the candidates would have to be scored it gives up and returns a
+// measure of -1, for the caller to score every node in bulk (counted by
+// _scan_argmax, or with _count_bulk). the nodes whose bounds beat the best
+// score so far are all that may still need scoring, so this shows after the
+// first batch.
+NodeMeasure _lazy_argmax(
+    const vector<LInt>& bounds,
+    const vector<char>& is_seed,
+    const vector<LInt>& candidates,
+    const std::function<LInt(const LInt&)>& evaluate,
+    const int& num_threads,
+    GreedyStats* stats) {
+
+  // whether a ranks below b.
+  auto below = [](const NodeMeasure& a, const NodeMeasure& b) -> bool {
+    return a.measure < b.measure || (a.measure == b.measure && a.id > b.id);
+  };
+
+  // best bound first. the unscored nodes that beat a score are a prefix of
+  // what is left, so counting them is a binary search.
+  auto order = vector<NodeMeasure>();
+  for (auto& v: candidates) {
+    if (!is_seed[v]) order.emplace_back(NodeMeasure(v, bounds[v]));
+  }
+  std::sort(order.begin(), order.end(),
+    [&below](const NodeMeasure& a, const NodeMeasure& b) -> bool { return below(b, a); });
+  LInt num_candidates = order.size();
+  auto next = order.begin();
+
+  auto best = NodeMeasure(0, -1);
+  auto batch = vector<NodeMeasure>();
+  LInt num_evaluated = 0;
+  LInt budget = std::max<LInt>(num_threads, num_candidates / 4);
+  bool gave_up = false;
+
+  while (true) {
+    batch.clear();
+    while (next != order.end() && (LInt)batch.size() < num_threads) {
+      if (best.measure >= 0 && !below(best, *next)) break;
+      batch.push_back(*next++);
+    }
+    if (batch.empty()) break;
+
+    #pragma omp parallel for schedule(dynamic) num_threads(num_threads)
+    for (size_t b = 0; b < batch.size(); b++) {
+      batch[b].measure = evaluate(batch[b].id);
+    }
+
+    num_evaluated += batch.size();
+    for (auto& x: batch) {
+      if (best.measure < 0 || below(best, x)) best = x;
+    }
+
+    auto open = std::partition_point(next, order.end(),
+      [&](const NodeMeasure& x) -> bool { return below(best, x); }) - next;
+    if (num_evaluated + open > budget) {
+      gave_up = true;
+      best = NodeMeasure(0, -1);
+      break;
+    }
+  }
+
+  if (stats != nullptr) {
+    #pragma omp atomic
+    stats->evaluations += num_evaluated;
+    if (!gave_up) {
+      #pragma omp atomic
+      stats->skipped += num_candidates - num_evaluated;
+    }
+  }
+
+  return best;
+}
+
+// scores every candidate that is not a seed, num_threads at a time; ties go
+// to the smallest id. this is the bulk pass of a pruned greedy step, and it
+// counts the nodes it scored into stats.
+NodeMeasure _scan_argmax(
+    const vector<LInt>& candidates,
+    const vector<char>& is_seed,
+    const std::function<LInt(const LInt&)>& evaluate,
+    const int& num_threads,
+    GreedyStats* stats = nullptr) {
+
+  auto best = NodeMeasure(0, -1);
+  LInt num_evaluated = 0;
+
+  #pragma omp parallel num_threads(num_threads) reduction(+:num_evaluated)
+  {
+    auto local_best = NodeMeasure(0, -1);
+
+    #pragma omp for schedule(dynamic, 64)
+    for (size_t k = 0; k < candidates.size(); k++) {
+      auto v = candidates[k];
+      if (is_seed[v]) continue;
+      auto m = evaluate(v);
+      num_evaluated++;
+      if (m > local_best.measure) local_best = NodeMeasure(v, m);
+    }
+
+    #pragma omp critical
+    if (local_best.measure > best.measure ||
+        (local_best.measure == best.measure && local_best.id < best.id)) {
+      best = local_best;
+    }
+  }
+
+  if (stats != nullptr) {
+    #pragma omp atomic
+    stats->evaluations += num_evaluated;
+  }
+
+  return best;
+}
+
+// the ids, in increasing order, of the nodes a pruned greedy keeps after its
+// first step: the top share (if candidates < 1) or top count of them by the
+// first step's measures, ties to the smaller id, and never fewer than the
+// seed_size the greedy picks from them. every id if candidates is 0.
+vector<LInt> _top_candidates(
+    const vector<LInt>& measures, const double& candidates, const LInt& seed_size) {
+  LInt n = measures.size();
+  auto ret = vector<LInt>(n);
+  std::iota(ret.begin(), ret.end(), 0);
+
+  LInt keep = (candidates < 1) ? std::ceil(candidates * n) : std::llround(candidates);
+  keep = std::max<LInt>({keep, seed_size, 1});
+  if (candidates <= 0 || keep >= n) return ret;
+
+  std::nth_element(ret.begin(), ret.begin() + keep - 1, ret.end(),
+    [&](const LInt& a, const LInt& b) -> bool {
+      return measures[a] > measures[b] || (measures[a] == measures[b] && a < b);
+    });
+  ret.resize(keep);
+  std::sort(ret.begin(), ret.end());
+  return ret;
+}
+
+void _count_bulk(GreedyStats* stats, const LInt& num_candidates) {
+  if (stats == nullptr) return;
+  #pragma omp atomic
+  stats->evaluations += num_candidates;
+}
+
+// the implicit nodes' gain goes to implicit_measure, which every non-seed node
+// receives when gathered; a listed node takes its own gain less that share.
+void _update_node_measure(
+    vector<LInt>& node_indexed_measure,
+    LInt& implicit_measure,
+    const PackedCover& cover,
+    const ComponentGains& gains,
+    const vector<char>& is_seed) {
+
+  auto& m = node_indexed_measure;
+  auto g = gains.implicit_of(cover);
+  implicit_measure += g;
+  for (LInt k = 0; k < cover.num_listed(); k++) {
+    auto i = cover.node_at(k);
+    if (is_seed[i]) continue;
+    m[i] += gains.of(cover.comp_at(k)) - g;
   }
   return;
 }
 
 void _gather_node_measure(
-    const unique_ptr<vector<LInt>>& node_indexed_measure,
+    const vector<LInt>& node_indexed_measure,
+    const LInt& implicit_measure,
+    const vector<char>& is_seed,
     unique_ptr<vector<NodeMeasure>>& node_measure) {
 
   for (size_t i = 0; i < node_measure->size(); i++) {
-    node_measure->at(i).measure += node_indexed_measure->at(i);
+    if (is_seed[i]) continue;
+    node_measure->at(i).measure += node_indexed_measure[i] + implicit_measure;
   }
 }
 
-NodeMeasure _greedy_exp(
-    const unique_ptr<GraphByEdges>& graph_edges,
-    const unique_ptr<vector<Node>>& nodes,
+// every node's marginal coverage summed over the samples, 0 for seeds.
+// evaluates against csc if given, else against samples first_sample ..
+// first_sample + num_samples - 1 of the rand_seed stream.
+unique_ptr<vector<NodeMeasure>> _exp_measures(
+    const graph::Sampler& sampler,
     const unique_ptr<set<LInt>>& kset_ids,
-    const vector<unique_ptr<Dice>>& dices,
+    const CompactSampleCollection* csc,
+    const int& rand_seed,
+    const LInt& first_sample,
     const int& num_samples,
-    const int& num_threads) {
+    const int& num_threads,
+    ScratchPool& pool) {
 
-  auto batch_size = num_samples / num_threads;
-  auto node_measure = make_unique<vector<NodeMeasure>>(nodes->size());
+  auto node_measure = make_unique<vector<NodeMeasure>>(sampler.num_nodes());
 
   for (size_t i = 0; i < node_measure->size(); i++) {
     node_measure->at(i).id = i;
     node_measure->at(i).measure = 0;
   }
 
-  #pragma omp parallel for
-  for (int i = 0; i < num_threads; i++) {
-    auto node_indexed_measure = make_unique<vector<LInt>>(nodes->size(), 0);
-
-    for (int j = 0; j < batch_size; j++) {
-      auto g = graph::sample_graph(graph_edges, nodes, dices[i]);
-      auto temp = graph::connected_component(g);
-      unique_ptr<vector<NodeIndexedCover>> nics = graph::get_cover(g);
-
-      _update_node_measure(node_indexed_measure, nics, kset_ids);
+  auto& is_seed = _seed_flags(pool.get().is_seed, sampler.num_nodes(), *kset_ids);
+
+  auto loop = SampleLoop();
+  #pragma omp parallel num_threads(num_threads)
+  {
+    auto& scratch = pool.get();
+    auto& node_indexed_measure = scratch.measure;
+    node_indexed_measure.assign(sampler.num_nodes(), 0);
+    LInt implicit_measure = 0;
+    auto buffer = SampleBuffer(scratch.covers, first_sample, first_sample + num_samples);
+    auto& gains = scratch.gains;
+    gains.fit(sampler.num_nodes());
+    auto timer = LoopTimer(loop);
+
+    #pragma omp for schedule(dynamic, sampler.batch_size()) nowait
+    for (int j = 0; j < num_samples; j++) {
+      auto& cover = _get_sample(
+        sampler, csc, rand_seed, first_sample + j, scratch.sample, buffer);
+      gains.build(cover, *kset_ids);
+      _update_node_measure(node_indexed_measure, implicit_measure, cover, gains, is_seed);
+      timer.samples++;
     }
+    timer.stop();
 
     #pragma omp critical
-    _gather_node_measure(node_indexed_measure, node_measure);
+    _gather_node_measure(node_indexed_measure, implicit_measure, is_seed, node_measure);
   }
 
-  auto max_iterator = std::max_element(
-    node_measure->begin(), node_measure->end(),
+  return node_measure;
+}
+
+NodeMeasure _argmax(const vector<NodeMeasure>& measures) {
+  return *std::max_element(
+    measures.begin(), measures.end(),
     [](const NodeMeasure& lhs, const NodeMeasure& rhs) -> bool {
       return lhs.measure < rhs.measure;
     });
-
-  return *max_iterator;
 }
 
-std::unique_ptr<std::vector<datatypes::NodeMeasure>> max_exp_infl(
-    const std::unique_ptr<datatypes::GraphByEdges>& graph_edges,
-    const std::unique_ptr<std::vector<datatypes::Node>>& nodes,
+// greedy on a shared collection. expected coverage is submodular, so a node's
+// last marginal bounds its next one and the steps after the first go through
+// _lazy_argmax, over the nodes _top_candidates keeps. the steps rank nodes by
+// their marginals summed over the samples; a seed's measure is the mean.
+unique_ptr<vector<NodeMeasure>> _lazy_greedy_exp(
+    const graph::Sampler& sampler,
+    const CompactSampleCollection& csc,
     const int& seed_size,
-    const int& num_samples,
+    const double& candidates,
     const int& num_threads,
-    const int& rand_seed) {
+    ScratchPool& pool,
+    GreedyStats* stats) {
 
   auto kset = make_unique<vector<NodeMeasure>>();
   kset->reserve(seed_size);
-  auto kset_ids = make_unique<set<LInt>>();
+  LInt n = sampler.num_nodes();
+  LInt num_samples = csc->size();
 
-  auto dices = vector<unique_ptr<Dice>>(num_threads);
-  for (int i = 0; i < num_threads; i++) {
-    dices[i] = make_unique<STDice>((i+1) * rand_seed);
-  }
+  auto first = _exp_measures(
+    sampler, make_unique<set<LInt>>(), &csc, 0, 0, num_samples, num_threads, pool);
+  auto bounds = vector<LInt>(n);
+  for (LInt v = 0; v < n; v++) bounds[v] = (*first)[v].measure;
+  auto kept = _top_candidates(bounds, candidates, seed_size);
+  bool pruned = (LInt)kept.size() < n;
+
+  auto kset_ids = make_unique<set<LInt>>();
+  auto is_seed = vector<char>(n, 0);
+  auto seed_covers = SeedCovers(*csc);
+  auto evaluate = [&](const LInt& v) -> LInt {
+    LInt g = 0;
+    for (LInt s = 0; s < num_samples; s++) g += seed_covers.gain(s, v);
+    bounds[v] = g;
+    return g;
+  };
 
   for (int i = 0; i < seed_size; i++) {
-    NodeMeasure best = _greedy_exp(graph_edges, nodes, kset_ids, dices, num_samples, num_threads);
-    kset->push_back(best);
+    auto best = (i == 0) ? _argmax(*first) :
+      _lazy_argmax(bounds, is_seed, kept, evaluate, num_threads, stats);
+    if (best.measure < 0 && pruned) {
+      best = _scan_argmax(kept, is_seed, evaluate, num_threads, stats);
+    }
+    if (best.measure < 0) {
+      auto all = _exp_measures(
+        sampler, kset_ids, &csc, 0, 0, num_samples, num_threads, pool);
+      for (LInt v = 0; v < n; v++) bounds[v] = (*all)[v].measure;
+      best = _argmax(*all);
+      _count_bulk(stats, n - i);
+    }
+    kset->push_back(NodeMeasure(best.id, best.measure / num_samples));
     kset_ids->insert(best.id);
+    is_seed[best.id] = 1;
+    seed_covers.add(best.id);
   }
 
   return kset;
 }
 
-struct NodeLoHiCount {
-  LInt id;
-  LInt lo, hi, count;
+std::unique_ptr<std::vector<datatypes::NodeMeasure>> max_exp_infl(
+    const graph::Sampler& sampler,
+    const int& seed_size,
+    const int& num_samples,
+    const int& num_threads,
+    const int& rand_seed,
+    const bool& fresh_samples,
+    const double& candidates,
+    GreedyStats* stats) {
+
+  auto pool = ScratchPool();
+  if (!fresh_samples) {
+    auto csc = _get_samples_collection(sampler, rand_seed, 0, num_samples, num_threads, pool);
+    return _lazy_greedy_exp(sampler, csc, seed_size, candidates, num_threads, pool, stats);
+  }
 
-  NodeLoHiCount() : id(0), lo(0), hi(0), count(0) {}
+  auto kset = make_unique<vector<NodeMeasure>>();
+  kset->reserve(seed_size);
+  auto kset_ids = make_unique<set<LInt>>();
 
-  NodeLoHiCount(LInt id, LInt lo, LInt hi, LInt count) :
-    id(id), lo(lo), hi(hi), count(count) {}
-};
+  for (int i = 0; i < seed_size; i++) {
+    NodeMeasure best = _argmax(*_exp_measures(
+      sampler, kset_ids, nullptr, rand_seed, (LInt)i * num_samples, num_samples, num_threads,
+      pool));
+    kset->push_back(NodeMeasure(best.id, best.measure / num_samples));
+    kset_ids->insert(best.id);
+  }
 
-void _update_feasible_count(
-    unique_ptr<vector<NodeLoHiCount>>& node_lhcs,
-    const unique_ptr<vector<NodeIndexedCover>>& nics,
-    const unique_ptr<set<LInt>>& kset_ids) {
+  return kset;
+}
 
-  auto base_ccids = set<LInt>();
-  LInt base_covered = 0;
-  for (auto& u: *kset_ids) {
-    auto iter_bool = base_ccids.insert(nics->at(u).cc_id);
-    if (iter_bool.second) base_covered += nics->at(u).cc_size;
+std::vector<std::unique_ptr<std::vector<datatypes::NodeMeasure>>> max_exp_infl_levels(
+    const graph::Sampler& sampler,
+    const std::vector<float>& levels,
+    const int& seed_size,
+    const int& num_samples,
+    const int& num_threads,
+    const int& rand_seed,
+    const double& candidates,
+    GreedyStats* stats) {
+
+  auto pool = ScratchPool();
+  auto cscs = _get_level_collections(
+    sampler, levels, rand_seed, 0, num_samples, num_threads, pool);
+
+  auto ret = vector<unique_ptr<vector<NodeMeasure>>>();
+  for (auto& csc: cscs) {
+    ret.push_back(
+      _lazy_greedy_exp(sampler, csc, seed_size, candidates, num_threads, pool, stats));
   }
+  return ret;
+}
 
-  for (size_t i = 0; i < node_lhcs->size(); i++) {
-    auto t = kset_ids->find(i);
-    if (t != kset_ids->end()) continue;
+// every node has its own threshold, so the coverage of a sparse cover's implicit
+// nodes is kept in implicit_values and counted against each node by
+// _tally_implicit_count; a listed node takes back what that will add for it.
+void _update_feasible_count(
+    vector<NodeLoHiCount>& node_lhcs,
+    vector<LInt>& implicit_values,
+    const PackedCover& cover,
+    const ComponentGains& gains,
+    const vector<char>& is_seed) {
+
+  auto v = gains.base_covered + gains.implicit_of(cover);
+  if (cover.sparse) implicit_values.push_back(v);
+
+  for (LInt k = 0; k < cover.num_listed(); k++) {
+    auto i = cover.node_at(k);
+    if (is_seed[i]) continue;
+
+    auto& nlhc = node_lhcs[i];
+    auto mid = (nlhc.lo + nlhc.hi) / 2;
+    auto m = gains.base_covered + gains.of(cover.comp_at(k));
+    nlhc.count += (m > mid) - (cover.sparse && v > mid);
+  }
+  return;
+}
 
-    auto m = base_covered;
-    auto& nlhc = node_lhcs->at(i);
+void _tally_implicit_count(
+    unique_ptr<vector<NodeLoHiCount>>& node_lhcs,
+    vector<LInt>& implicit_values,
+    const vector<char>& is_seed) {
 
-    auto ccid = nics->at(i).cc_id;
-    auto find = base_ccids.find(ccid);
+  if (implicit_values.empty()) return;
+  std::sort(implicit_values.begin(), implicit_values.end());
 
-    if (find == base_ccids.end()) m += nics->at(i).cc_size;
+  for (size_t i = 0; i < node_lhcs->size(); i++) {
+    if (is_seed[i]) continue;
 
-    if (m > (nlhc.lo + nlhc.hi) / 2) nlhc.count += 1;
+    auto& nlhc = (*node_lhcs)[i];
+    auto mid = (nlhc.lo + nlhc.hi) / 2;
+    nlhc.count += implicit_values.end() -
+      std::upper_bound(implicit_values.begin(), implicit_values.end(), mid);
   }
   return;
 }
 
 void _tally_feasible_count(
     unique_ptr<vector<NodeLoHiCount>>& node_lhcs,
-    const unique_ptr<vector<NodeLoHiCount>>& local_node_lhcs) {
+    const vector<NodeLoHiCount>& local_node_lhcs) {
 
   std::transform(
-    node_lhcs->begin(), node_lhcs->end(), local_node_lhcs->begin(),
+    node_lhcs->begin(), node_lhcs->end(), local_node_lhcs.begin(),
     node_lhcs->begin(),
-    [](NodeLoHiCount& acc, NodeLoHiCount& part) -> NodeLoHiCount {
+    [](const NodeLoHiCount& acc, const NodeLoHiCount& part) -> NodeLoHiCount {
       return NodeLoHiCount(acc.id, acc.lo, acc.hi, acc.count + part.count);
     });
 
   return;
 }
 
-NodeMeasure _greedy_prob(
-    const unique_ptr<GraphByEdges>& graph_edges,
-    const unique_ptr<vector<Node>>& nodes,
+inline LInt _quantile_rank(const double& prob, const LInt& num_samples) {
+  return std::min<LInt>(num_samples, std::floor(prob * num_samples) + 1);
+}
+
+// the exact empirical version of _prob_measures: a candidate's measure is the
+// t-th largest of its coverage values over the samples, t = floor(prob * S) + 1,
+// i.e. the largest value reached in more than prob * S samples. values are
+// gathered for a block of nodes at a time and the quantile read with nth_element.
+// seeds get -1. given spread d, upper and lower get the (t - d)-th and
+// (t + d)-th largest values, clamped to 1 .. S, as well.
+vector<LInt> _quantile_measures(
+    const CompactSampleCollection& csc,
     const double& prob,
     const unique_ptr<set<LInt>>& kset_ids,
-    const vector<unique_ptr<Dice>>& dices,
+    const int& num_threads,
+    ScratchPool& pool,
+    const LInt& spread = 0,
+    vector<LInt>* upper = nullptr,
+    vector<LInt>* lower = nullptr) {
+
+  LInt num_samples = csc->size();
+  LInt n = csc->at(0).num_nodes;
+  LInt t = _quantile_rank(prob, num_samples);
+
+  // a ComponentGains per sample would cost n per sample, so keep only the few
+  // covered components of each sample, sorted.
+  auto& scratch = pool.get();
+  auto& base_covered = scratch.base_covered;
+  base_covered.assign(num_samples, 0);
+  auto& base_ccids = scratch.base_ccids;
+  if ((LInt)base_ccids.size() < num_samples) base_ccids.resize(num_samples);
+  for (LInt s = 0; s < num_samples; s++) {
+    auto& cover = (*csc)[s];
+    auto& ccids = base_ccids[s];
+    ccids.clear();
+    for (auto& u: *kset_ids) {
+      auto c = cover.comp(u);
+      if (c == 0) base_covered[s] += 1;
+      else ccids.push_back(c);
+    }
+    std::sort(ccids.begin(), ccids.end());
+    ccids.erase(std::unique(ccids.begin(), ccids.end()), ccids.end());
+    for (auto& c: ccids) base_covered[s] += cover.sizes[c];
+  }
+  auto& is_seed = _seed_flags(scratch.is_seed, n, *kset_ids);
+
+  const LInt block_size = 256;
+  auto ret = vector<LInt>(n, -1);
+  LInt r_hi = std::max<LInt>(1, t - spread);
+  LInt r_lo = std::min(num_samples, t + spread);
+  if (spread > 0) {
+    upper->assign(n, -1);
+    lower->assign(n, -1);
+  }
+
+  #pragma omp parallel num_threads(num_threads)
+  {
+    auto& values = pool.get().values;
+    values.resize(block_size * num_samples);
+
+    #pragma omp for schedule(dynamic)
+    for (LInt b = 0; b < n; b += block_size) {
+      auto e = std::min(n, b + block_size);
+
+      for (LInt s = 0; s < num_samples; s++) {
+        auto& cover = (*csc)[s];
+        auto& ccids = base_ccids[s];
+        auto value_of = [&](VInt c) -> LInt {
+          auto m = base_covered[s];
+          if (!std::binary_search(ccids.begin(), ccids.end(), c)) m += cover.sizes[c];
+          return m;
+        };
+
+        if (cover.sparse) {
+          auto m = value_of(cover.implicit);
+          for (LInt i = b; i < e; i++) values[(i - b) * num_samples + s] = m;
+        }
+        for (LInt k = cover.lower(b); k < cover.num_listed(); k++) {
+          auto i = cover.node_at(k);
+          if (i >= e) break;
+          values[(i - b) * num_samples + s] = value_of(cover.comp_at(k));
+        }
+      }
+
+      for (LInt i = b; i < e; i++) {
+        if (is_seed[i]) continue;
+
+        auto first = values.begin() + (i - b) * num_samples;
+        // each nth_element leaves the larger values in front for the next.
+        auto end = first + num_samples;
+        if (spread > 0) {
+          std::nth_element(first, first + r_lo - 1, end, std::greater<LInt>());
+          (*lower)[i] = *(first + r_lo - 1);
+          end = first + r_lo;
+        }
+        std::nth_element(first, first + t - 1, end, std::greater<LInt>());
+        ret[i] = *(first + t - 1);
+        if (spread > 0) {
+          std::nth_element(first, first + r_hi - 1, first + t, std::greater<LInt>());
+          (*upper)[i] = *(first + r_hi - 1);
+        }
+      }
+    }
+  }
+
+  return ret;
+}
+
+// every node's binary-searched measure. every step evaluates against csc if
+// given, else draws its own num_samples samples, starting at first_sample of
+// the rand_seed stream.
+vector<LInt> _prob_measures(
+    const graph::Sampler& sampler,
+    const double& prob,
+    const unique_ptr<set<LInt>>& kset_ids,
+    const CompactSampleCollection* csc,
+    const int& rand_seed,
+    const LInt& first_sample,
     const int& num_samples,
-    const int& num_threads) {
+    const int& num_threads,
+    ScratchPool& pool) {
 
-  auto batch_size = num_samples / num_threads;
-  auto n = nodes->size();
+  size_t n = sampler.num_nodes();
   auto threshold = prob * num_samples;
   auto num_steps = std::llround(std::log(n) / std::log(2));
 
+  auto& is_seed = _seed_flags(pool.get().is_seed, n, *kset_ids);
   auto node_lhcs = make_unique<vector<NodeLoHiCount>>();
   node_lhcs->reserve(n);
   for (size_t i = 0; i < n; i++) {
     node_lhcs->emplace_back(NodeLoHiCount(i, 1, n, 0));
   }
 
+  auto implicit_values = vector<LInt>();
   for (int e = 0; e < num_steps; e++) {
     for (auto& nlhc: *node_lhcs) nlhc.count = 0;
+    implicit_values.clear();
+
+    auto step_first_sample = csc ? 0 : first_sample + (LInt)e * num_samples;
 
-    #pragma omp parallel for
-    for (int j = 0; j < num_threads; j++) {
-      auto local_node_lhcs = make_unique<vector<NodeLoHiCount>>();
-      local_node_lhcs->reserve(n);
+    auto loop = SampleLoop();
+    #pragma omp parallel num_threads(num_threads)
+    {
+      // every step refills the thread's own tables.
+      auto& scratch = pool.get();
+      auto& local_node_lhcs = scratch.node_lhcs;
+      local_node_lhcs.resize(n);
       for (size_t i = 0; i < n; i++) {
-        local_node_lhcs->emplace_back(
-          NodeLoHiCount(i, node_lhcs->at(i).lo, node_lhcs->at(i).hi, 0));
+        local_node_lhcs[i] = NodeLoHiCount(i, (*node_lhcs)[i].lo, (*node_lhcs)[i].hi, 0);
       }
-
-      for (int i = 0; i < batch_size; i++) {
-        auto g = graph::sample_graph(graph_edges, nodes, dices[j]);
-        auto tmp = graph::connected_component(g);
-        auto nics = graph::get_cover(g);
-        _update_feasible_count(local_node_lhcs, nics, kset_ids);
+      auto& local_implicit_values = scratch.implicit_values;
+      local_implicit_values.clear();
+      auto buffer = SampleBuffer(
+        scratch.covers, step_first_sample, step_first_sample + num_samples);
+      auto& gains = scratch.gains;
+      gains.fit(n);
+      auto timer = LoopTimer(loop);
+
+      #pragma omp for schedule(dynamic, sampler.batch_size()) nowait
+      for (int j = 0; j < num_samples; j++) {
+        auto& cover = _get_sample(
+          sampler, csc, rand_seed, step_first_sample + j, scratch.sample, buffer);
+        gains.build(cover, *kset_ids);
+        _update_feasible_count(local_node_lhcs, local_implicit_values, cover, gains, is_seed);
+        timer.samples++;
       }
+      timer.stop();
 
       #pragma omp critical
-      _tally_feasible_count(node_lhcs, local_node_lhcs);
+      {
+        _tally_feasible_count(node_lhcs, local_node_lhcs);
+        implicit_values.insert(
+          implicit_values.end(), local_implicit_values.begin(), local_implicit_values.end());
+      }
     }
 
+    _tally_implicit_count(node_lhcs, implicit_values, is_seed);
+
     for (auto& nlhc: *node_lhcs) {
       auto mid = (nlhc.lo + nlhc.hi) / 2;
       if (nlhc.count > threshold) {
@@ -230,178 +1070,737 @@ NodeMeasure _greedy_prob(
 
   } // for num_steps
 
-  auto max_iterator = std::max_element(
-    node_lhcs->begin(), node_lhcs->end(),
-    [](const NodeLoHiCount &lhs, const NodeLoHiCount &rhs) -> bool {
-      return (lhs.lo < rhs.lo);
-    });
+  auto ret = vector<LInt>(n);
+  for (size_t i = 0; i < n; i++) ret[i] = (*node_lhcs)[i].lo;
+  return ret;
+}
 
-  return NodeMeasure(max_iterator->id, max_iterator->lo);
+// the number of times a run that doubles its samples from size up to cap
+// tests them; at cap it stops testing.
+LInt _num_looks(LInt size, const LInt& cap) {
+  LInt looks = 0;
+  for (; size < cap; size *= 2) looks++;
+  return std::max<LInt>(1, looks);
 }
 
-std::unique_ptr<std::vector<datatypes::NodeMeasure>> max_prob_infl(
-    const std::unique_ptr<datatypes::GraphByEdges>& graph_edges,
-    const std::unique_ptr<std::vector<datatypes::Node>>& nodes,
+// the quantile measures of a greedy step on csc, which grows by doubling, from
+// sample first_sample of the rand_seed stream on, up to num_samples until,
+// with the given confidence, no node's quantile is more than the tolerance
+// above the best's; quantiles are small integers and often tie, so a strict
+// separation would mostly run to the cap. the number of the samples at or
+// above a node's true quantile is binomial, so the bounds on it are the order
+// statistics d ranks either side of t, d from Hoeffding's inequality at the
+// confidence split over every node and every look.
+vector<LInt> _adaptive_quantile_measures(
+    const graph::Sampler& sampler,
+    const double& prob,
+    const unique_ptr<set<LInt>>& kset_ids,
+    const int& rand_seed,
+    const LInt& first_sample,
+    const int& num_samples,
+    const int& num_threads,
+    ScratchPool& pool,
+    AdaptiveSampling& adaptive,
+    CompactSampleCollection& csc) {
+
+  LInt num_nodes = sampler.num_nodes() - kset_ids->size();
+  double risk = (1 - adaptive.confidence) / num_nodes / _num_looks(csc->size(), num_samples);
+  auto upper = vector<LInt>();
+  auto lower = vector<LInt>();
+
+  while (true) {
+    LInt size = csc->size();
+    if (size >= num_samples) {
+      adaptive.samples_used.push_back(size);
+      return _quantile_measures(csc, prob, kset_ids, num_threads, pool);
+    }
+
+    LInt spread = std::ceil(std::sqrt(size * std::log(2 / risk) / 2));
+    auto m = _quantile_measures(
+      csc, prob, kset_ids, num_threads, pool, spread, &upper, &lower);
+
+    auto best = std::max_element(m.begin(), m.end()) - m.begin();
+    LInt rival = -1;
+    for (size_t v = 0; v < m.size(); v++) {
+      if ((LInt)v != best) rival = std::max(rival, upper[v]);
+    }
+
+    if (lower[best] + adaptive.tolerance >= rival) {
+      adaptive.samples_used.push_back(size);
+      return m;
+    }
+    _extend_samples_collection(
+      sampler, rand_seed, first_sample, std::min<LInt>(2 * size, num_samples), num_threads,
+      pool, *csc);
+  }
+}
+
+// max_prob_infl on the shared collection csc, which is drawn here unless
+// given or fresh_samples.
+unique_ptr<vector<NodeMeasure>> _greedy_prob_infl(
+    const graph::Sampler& sampler,
     const double& prob,
     const int& seed_size,
     const int& num_samples,
     const int& num_threads,
-    const int& rand_seed) {
+    ScratchPool& pool,
+    const int& rand_seed,
+    const bool& fresh_samples,
+    const bool& exact_quantile,
+    const double& candidates,
+    AdaptiveSampling* adaptive,
+    CompactSampleCollection& csc) {
 
   auto kset = make_unique<vector<NodeMeasure>>();
   kset->reserve(seed_size);
   auto kset_ids = make_unique<set<LInt>>();
+  LInt n = sampler.num_nodes();
 
-  auto dices = vector<unique_ptr<Dice>>();
-  dices.reserve(num_threads);
-  for (int i = 0; i < num_threads; i++) {
-    dices.push_back(make_unique<STDice>((i+1) * rand_seed));
+  auto num_steps = std::llround(std::log(n) / std::log(2));
+
+  // adaptive steps start small; a shared collection keeps what they grew it to.
+  // their stopping rule bounds the exact quantile, so they need it.
+  bool adapt = (adaptive != nullptr);
+  if (adapt && !exact_quantile) {
+    throw std::invalid_argument("adaptive max_prob_infl needs the exact quantile");
+  }
+  int first_size = adapt ? std::min(adaptive->min_samples, num_samples) : num_samples;
+
+  if (!csc && !fresh_samples) {
+    csc = _get_samples_collection(sampler, rand_seed, 0, first_size, num_threads, pool);
   }
 
+  // once pruned, a step scores the kept candidates one at a time, by the same
+  // quantile or binary search as the bulk kernels, from seed_covers.
+  auto kept = vector<LInt>();
+  bool pruned = false;
+  auto is_seed = vector<char>(n, 0);
+  unique_ptr<SeedCovers> seed_covers;
+  LInt kept_samples = 0;
+  auto evaluate = [&](const LInt& v) -> LInt {
+    auto t = _quantile_rank(prob, kept_samples);
+    auto threshold = prob * kept_samples;
+    auto& values = pool.get().values;
+    values.resize(kept_samples);
+    for (LInt s = 0; s < kept_samples; s++) {
+      values[s] = seed_covers->base[s] + seed_covers->gain(s, v);
+    }
+    if (exact_quantile) {
+      std::nth_element(
+        values.begin(), values.begin() + t - 1, values.end(), std::greater<LInt>());
+      return values[t - 1];
+    }
+    std::sort(values.begin(), values.end());
+    LInt lo = 1, hi = n;
+    for (int e = 0; e < num_steps; e++) {
+      auto mid = (lo + hi) / 2;
+      LInt count = values.end() - std::upper_bound(values.begin(), values.end(), mid);
+      if (count > threshold) {
+        lo = mid;
+      } else {
+        hi = mid;
+      }
+    }
+    return lo;
+  };
+
   for (int i = 0; i < seed_size; i++) {
-    NodeMeasure best =
-      _greedy_prob(graph_edges, nodes, prob, kset_ids, dices, num_samples, num_threads);
+    auto best = NodeMeasure(0, -1);
+    if (pruned) best = _scan_argmax(kept, is_seed, evaluate, num_threads);
+    if (best.measure < 0) {
+      vector<LInt> m;
+      if (exact_quantile) {
+        LInt first_sample = csc ? 0 : (LInt)i * num_samples;
+        auto step_csc = csc ? CompactSampleCollection() : _get_samples_collection(
+          sampler, rand_seed, first_sample, first_size, num_threads, pool, true);
+        auto& c = csc ? csc : step_csc;
+        m = adapt ?
+          _adaptive_quantile_measures(
+            sampler, prob, kset_ids, rand_seed, first_sample, num_samples, num_threads,
+            pool, *adaptive, c) :
+          _quantile_measures(c, prob, kset_ids, num_threads, pool);
+      } else {
+        m = _prob_measures(
+          sampler, prob, kset_ids, csc ? &csc : nullptr, rand_seed,
+          (LInt)i * num_steps * num_samples, num_samples, num_threads, pool);
+      }
+      auto v = std::max_element(m.begin(), m.end()) - m.begin();
+      best = NodeMeasure(v, m[v]);
+
+      if (i == 0 && csc) {
+        kept = _top_candidates(m, candidates, seed_size);
+        pruned = (LInt)kept.size() < n;
+        if (pruned) {
+          seed_covers = make_unique<SeedCovers>(*csc);
+          kept_samples = csc->size();
+        }
+      }
+    }
     kset->push_back(best);
     kset_ids->insert(best.id);
+    is_seed[best.id] = 1;
+    if (seed_covers) seed_covers->add(best.id);
   }
 
   return kset;
 }
 
-using CompactSampleCollection = unique_ptr<vector<unique_ptr<vector<NodeIndexedCover>>>>;
-
-CompactSampleCollection _get_samples_collection(
-    const unique_ptr<GraphByEdges>& graph_edges,
-    const unique_ptr<vector<Node>>& nodes,
-    const vector<unique_ptr<Dice>>& dices,
-    const size_t& num_samples,
-    const size_t& num_threads) {
-
-  auto ret =  make_unique<vector<unique_ptr<vector<NodeIndexedCover>>>>();
-  ret->resize(num_samples);
-
-  auto batch_size = num_samples / num_threads;
+std::unique_ptr<std::vector<datatypes::NodeMeasure>> max_prob_infl(
+    const graph::Sampler& sampler,
+    const double& prob,
+    const int& seed_size,
+    const int& num_samples,
+    const int& num_threads,
+    const int& rand_seed,
+    const bool& fresh_samples,
+    const bool& exact_quantile,
+    const double& candidates,
+    AdaptiveSampling* adaptive) {
+
+  auto pool = ScratchPool();
+  CompactSampleCollection csc;
+  return _greedy_prob_infl(
+    sampler, prob, seed_size, num_samples, num_threads, pool, rand_seed, fresh_samples,
+    exact_quantile, candidates, adaptive, csc);
+}
 
-  #pragma omp parallel for
-  for (size_t i = 0; i < num_threads; i++) {
-    auto r = i * batch_size;
-    for (size_t j = 0; j < batch_size; j++) {
-      auto g = graph::sample_graph(graph_edges, nodes, dices[i]);
-      auto tmp = graph::connected_component(g);
-      auto nics = graph::get_cover(g);
-      ret->at(r + j) = std::move(nics);
+std::vector<std::unique_ptr<std::vector<datatypes::NodeMeasure>>> max_prob_infl_levels(
+    const graph::Sampler& sampler,
+    const std::vector<float>& levels,
+    const std::vector<double>& probs,
+    const int& seed_size,
+    const int& num_samples,
+    const int& num_threads,
+    const int& rand_seed,
+    const bool& exact_quantile,
+    const double& candidates) {
+
+  auto pool = ScratchPool();
+  auto cscs = _get_level_collections(
+    sampler, levels, rand_seed, 0, num_samples, num_threads, pool);
+
+  auto ret = vector<unique_ptr<vector<NodeMeasure>>>();
+  for (auto& csc: cscs) {
+    for (auto& prob: probs) {
+      ret.push_back(_greedy_prob_infl(
+        sampler, prob, seed_size, num_samples, num_threads, pool, rand_seed, false,
+        exact_quantile, candidates, nullptr, csc));
     }
   }
-
   return ret;
 }
 
-NodeMeasure _greedy_bicriteria(
+// every node's truncated coverage, 0 for seeds. it is accumulated over the
+// samples by num_threads threads, each into its own scratch vector; the
+// vectors are then summed node by node in thread order.
+unique_ptr<vector<NodeMeasure>> _bicriteria_measures(
     const CompactSampleCollection& csc,
     const LInt& cutoff,
-    const set<LInt>& base_nodeids) {
+    const set<LInt>& base_nodeids,
+    const int& num_threads,
+    ScratchPool& pool) {
+
+  LInt n = csc->at(0).num_nodes;
+  LInt num_samples = csc->size();
+  auto& is_seed = _seed_flags(pool.get().is_seed, n, base_nodeids);
 
   auto fmsr = make_unique<vector<NodeMeasure>>();
-  fmsr->reserve(csc->at(0)->size());
-  for (size_t i = 0; i < csc->at(0)->size(); i++) {
+  fmsr->reserve(n);
+  for (LInt i = 0; i < n; i++) {
     fmsr->emplace_back(NodeMeasure(i, 0));
   }
 
-  for (auto& nics: *csc) {
-    auto base_ccids = set<LInt>();
-    LInt base_covered = 0;
-    for (auto& x: base_nodeids) {
-      auto iter_bool = base_ccids.insert(nics->at(x).cc_id);
-      if (iter_bool.second) base_covered += nics->at(x).cc_size;
+  auto partials = vector<vector<LInt>*>();
+
+  auto loop = SampleLoop();
+  #pragma omp parallel num_threads(num_threads)
+  {
+    #pragma omp single
+    partials.resize(omp_get_num_threads());
+
+    auto& scratch = pool.get();
+    auto& acc = scratch.measure;
+    partials[omp_get_thread_num()] = &acc;
+    acc.assign(n + 1, 0);
+    auto& gains = scratch.gains;
+    gains.fit(n);
+    auto timer = LoopTimer(loop);
+
+    // acc[n] holds the implicit nodes' share, as in _update_node_measure.
+    #pragma omp for schedule(dynamic, 4) nowait
+    for (LInt s = 0; s < num_samples; s++) {
+      auto& cover = (*csc)[s];
+      gains.build(cover, base_nodeids);
+
+      LInt implicit_value = cover.sparse ?
+        std::min(gains.base_covered + gains.implicit_of(cover), cutoff) : 0;
+      acc[n] += implicit_value;
+
+      for (LInt k = 0; k < cover.num_listed(); k++) {
+        auto i = cover.node_at(k);
+        if (is_seed[i]) continue;
+
+        LInt value = gains.base_covered + gains.of(cover.comp_at(k));
+        acc[i] += std::min(value, cutoff) - implicit_value;
+      }
+      timer.samples++;
     }
+    timer.stop();
 
-    for (size_t i = 0; i < nics->size(); i++) {
-      LInt value = 0;
-
-      auto t = base_nodeids.find(i);
-      if (t != base_nodeids.end()) continue;
+    #pragma omp barrier
 
-      value = base_covered;
-      auto ccid = nics->at(i).cc_id;
-      auto find = base_ccids.find(ccid);
-
-      if (find == base_ccids.end()) value += nics->at(i).cc_size;
-
-      fmsr->at(i).measure += std::min(value, cutoff);
+    #pragma omp for schedule(static)
+    for (LInt i = 0; i < n; i++) {
+      if (is_seed[i]) continue;
+      for (auto& part: partials) (*fmsr)[i].measure += (*part)[i] + (*part)[n];
     }
   }
 
-  auto max_iterator = std::max_element(
-    fmsr->begin(), fmsr->end(),
-    [](const NodeMeasure& lhs, const NodeMeasure& rhs) -> bool {
-      return lhs.measure < rhs.measure;
-    });
-
-  return *max_iterator;
+  return fmsr;
 }
 
-void _update_feasibility(
+// truncated coverage is submodular too, so after the first seed the greedy
+// goes through _lazy_argmax on marginals, over the nodes _top_candidates keeps
+// from this round's first step; the measure kept is the total. with
+// confidence > 0 the test only settles once an empirical Bernstein bound
+// (Maurer and Pontil, 2009) on the mean of min(coverage, mid) / mid over the
+// samples puts prob on one side of it; otherwise it returns false and leaves
+// the round to be run again on more samples.
+bool _update_feasibility(
     Bicriteria& bicrit,
     const CompactSampleCollection& csc,
-    const double prob) {
+    const double prob,
+    const double& candidates,
+    const int& num_threads,
+    ScratchPool& pool,
+    GreedyStats* stats,
+    const double& confidence = 0) {
 
   auto mid = (bicrit.feasible_lo + bicrit.feasible_hi) / 2;
   double threshold = prob * mid * csc->size();
-  auto acc_msr = 0;
-  auto selected = set<LInt>();
+  LInt acc_msr = 0;
+  LInt n = csc->at(0).num_nodes;
+  LInt num_samples = csc->size();
 
   bicrit.seed_set = vector<NodeMeasure>();
   bicrit.seed_set.reserve(bicrit.seed_size);
 
-  while (selected.size() < bicrit.seed_size) {
-    NodeMeasure best = _greedy_bicriteria(csc, mid, selected);
+  auto first = _bicriteria_measures(csc, mid, set<LInt>(), num_threads, pool);
+  auto bounds = vector<LInt>(n);
+  for (LInt v = 0; v < n; v++) bounds[v] = (*first)[v].measure;
+  auto kept = _top_candidates(bounds, candidates, bicrit.seed_size);
+  bool pruned = (LInt)kept.size() < n;
+
+  auto selected = set<LInt>();
+  auto is_seed = vector<char>(n, 0);
+  auto seed_covers = SeedCovers(*csc);
+  auto evaluate = [&](const LInt& v) -> LInt {
+    LInt g = 0;
+    for (LInt s = 0; s < num_samples; s++) {
+      auto a = seed_covers.base[s];
+      g += std::min(a + seed_covers.gain(s, v), mid) - std::min(a, mid);
+    }
+    bounds[v] = g;
+    return g;
+  };
+
+  while ((LInt)bicrit.seed_set.size() < bicrit.seed_size) {
+    NodeMeasure best;
+    if (bicrit.seed_set.empty()) {
+      best = _argmax(*first);
+    } else {
+      best = _lazy_argmax(bounds, is_seed, kept, evaluate, num_threads, stats);
+      if (best.measure < 0 && pruned) {
+        best = _scan_argmax(kept, is_seed, evaluate, num_threads, stats);
+      }
+      if (best.measure >= 0) {
+        best.measure += acc_msr;
+      } else {
+        auto all = _bicriteria_measures(csc, mid, selected, num_threads, pool);
+        for (LInt v = 0; v < n; v++) bounds[v] = (*all)[v].measure - acc_msr;
+        best = _argmax(*all);
+        _count_bulk(stats, n - selected.size());
+      }
+    }
     acc_msr = best.measure;
     selected.insert(best.id);
+    is_seed[best.id] = 1;
+    seed_covers.add(best.id);
     bicrit.seed_set.emplace_back(NodeMeasure(best.id, best.measure / csc->size()));
   }
 
+  if (confidence > 0 && num_samples > 1) {
+    double mean = (double)acc_msr / mid / num_samples;
+    double var = 0;
+    for (LInt s = 0; s < num_samples; s++) {
+      double x = (double)std::min(seed_covers.base[s], mid) / mid - mean;
+      var += x * x;
+    }
+    var /= num_samples - 1;
+    double l = std::log(2 / (1 - confidence));
+    double radius = std::sqrt(2 * var * l / num_samples) + 7 * l / (3 * (num_samples - 1));
+    if (std::abs(mean - prob) <= radius) return false;
+  }
+
   if (acc_msr >= threshold) {
     bicrit.feasible_lo = mid;
   } else {
     bicrit.feasible_hi = mid;
   }
 
-  return;
+  return true;
+}
+
+// the binary-search rounds of all of bicrits at once: bicrit j is tested at
+// probs[j] against the round's collection at levels[level_of[j]], the levels'
+// collections drawn together; with no levels, level 0 is the sampler's own,
+// the one adaptive sampling grows.
+void _bicriteria_rounds(
+    const graph::Sampler& sampler,
+    const vector<float>& levels,
+    vector<Bicriteria>& bicrits,
+    const vector<double>& probs,
+    const vector<size_t>& level_of,
+    const int& num_samples,
+    const int& num_threads,
+    const int& rand_seed,
+    const double& candidates,
+    GreedyStats* stats,
+    AdaptiveSampling* adaptive) {
+
+  auto num_bicrits = bicrits.size();
+  auto num_steps = std::llround(std::log(sampler.num_nodes()) / std::log(2));
+  if (!levels.empty()) adaptive = nullptr;
+  auto pool = ScratchPool();
+
+  // adaptive rounds start small and double the round's samples for the seed
+  // sizes whose tests are still open, up to num_samples, where all settle.
+  // each test gets its share of the risk of a round's looks.
+  int first_size = adaptive ? std::min(adaptive->min_samples, num_samples) : num_samples;
+  double look_confidence = adaptive ?
+    1 - (1 - adaptive->confidence) / _num_looks(first_size, num_samples) : 0;
+
+  // the tests of one round, on its collections, by threads threads; open ones
+  // with adaptive sampling grow cscs[0] and run again. the seed sizes are
+  // independent: the threads are split between them, and each one runs its
+  // greedy kernel on its share.
+  auto run_round = [&](vector<CompactSampleCollection>& cscs, const LInt& e, const int& threads) {
+    int outer_threads = std::max(1, std::min<int>(num_bicrits, threads));
+    int inner_threads = std::max(1, threads / outer_threads);
+    auto& csc = cscs[0];
+    auto open = vector<size_t>(num_bicrits);
+    std::iota(open.begin(), open.end(), 0);
+
+    while (true) {
+      double confidence = (LInt)csc->size() < num_samples ? look_confidence : 0;
+      auto settled = vector<char>(open.size(), 0);
+
+      #pragma omp parallel for schedule(dynamic) num_threads(outer_threads)
+      for (size_t j = 0; j < open.size(); j++) {
+        auto b = open[j];
+        settled[j] = _update_feasibility(
+          bicrits[b], cscs[level_of[b]], probs[b], candidates, inner_threads, pool, stats,
+          confidence);
+      }
+
+      auto still_open = vector<size_t>();
+      for (size_t j = 0; j < open.size(); j++) {
+        if (!settled[j]) still_open.push_back(open[j]);
+      }
+      open.swap(still_open);
+      if (open.empty()) break;
+      _extend_samples_collection(
+        sampler, rand_seed, e * num_samples, std::min<LInt>(2 * csc->size(), num_samples),
+        threads, pool, *csc);
+    }
+
+    if (adaptive) adaptive->samples_used.push_back(csc->size());
+  };
+
+  // a round's samples do not depend on the tests before it, so with more than
+  // one thread the next round's collections are drawn while this round's tests
+  // run: one round ahead at most, which bounds the samples held to two
+  // rounds'. the threads are split between the two, not added: the drawing
+  // gets the share of them that drawing took of the last round's thread
+  // seconds, so both halves end about together. round 0 runs alone to measure
+  // that. the samples are keyed on their index, and the greedy picks do not
+  // depend on the thread count, so the overlap changes nothing in the results.
+  bool pipelined = (num_threads > 1);
+  auto nested = NestedLevels(pipelined ? 3 : 2);
+  double draw_work = 0;
+  double test_work = 0;
+
+  double t = omp_get_wtime();
+  auto next = _get_level_collections(
+    sampler, levels, rand_seed, 0, first_size, num_threads, pool);
+  draw_work = (omp_get_wtime() - t) * num_threads;
+
+  for (LInt e = 0; e < num_steps; e++) {
+    auto cscs = std::move(next);
+    next = vector<CompactSampleCollection>();
+    bool last = (e + 1 == num_steps);
+
+    if (pipelined && !last && test_work > 0) {
+      int draw_threads = std::llround(num_threads * draw_work / (draw_work + test_work));
+      draw_threads = std::max(1, std::min(num_threads - 1, draw_threads));
+      int test_threads = num_threads - draw_threads;
+      double draw_time = 0;
+      double test_time = 0;
+      // an exception cannot leave a section; it is thrown again after them.
+      std::exception_ptr failure;
+
+      #pragma omp parallel sections num_threads(2)
+      {
+        #pragma omp section
+        {
+          double start = omp_get_wtime();
+          try {
+            next = _get_level_collections(
+              sampler, levels, rand_seed, (e + 1) * num_samples, first_size, draw_threads,
+              pool);
+          } catch (...) {
+            failure = std::current_exception();
+          }
+          draw_time = omp_get_wtime() - start;
+        }
+        #pragma omp section
+        {
+          double start = omp_get_wtime();
+          run_round(cscs, e, test_threads);
+          test_time = omp_get_wtime() - start;
+        }
+      }
+      if (failure) std::rethrow_exception(failure);
+      draw_work = draw_time * draw_threads;
+      test_work = test_time * test_threads;
+    } else {
+      t = omp_get_wtime();
+      run_round(cscs, e, num_threads);
+      test_work = (omp_get_wtime() - t) * num_threads;
+      if (!last) {
+        t = omp_get_wtime();
+        next = _get_level_collections(
+          sampler, levels, rand_seed, (e + 1) * num_samples, first_size, num_threads, pool);
+        draw_work = (omp_get_wtime() - t) * num_threads;
+      }
+    }
+  }
 }
 
 std::unique_ptr<std::vector<datatypes::Bicriteria>> max_prob_bicriteria(
-    const std::unique_ptr<datatypes::GraphByEdges>& graph_edges,
-    const std::unique_ptr<std::vector<datatypes::Node>>& nodes,
+    const graph::Sampler& sampler,
     const double& prob,
     const std::unique_ptr<std::vector<datatypes::LInt>>& seed_sizes,
     const int& num_samples,
     const int& num_threads,
-    const int& rand_seed) {
+    const int& rand_seed,
+    const double& candidates,
+    GreedyStats* stats,
+    AdaptiveSampling* adaptive) {
 
   auto num_bicrits = seed_sizes->size();
 
   auto ret = make_unique<vector<Bicriteria>>();
   ret->reserve(num_bicrits);
   for (size_t i = 0; i < num_bicrits; i++) {
-    ret->emplace_back(Bicriteria(seed_sizes->at(i), nodes->size()));
+    ret->emplace_back(Bicriteria(seed_sizes->at(i), sampler.num_nodes()));
   }
 
-  auto dices = vector<unique_ptr<Dice>>();
-  dices.reserve(num_threads);
-  for (int i = 0; i < num_threads; i++) {
-    dices.push_back(make_unique<STDice>((i+1) * rand_seed));
+  _bicriteria_rounds(
+    sampler, vector<float>(), *ret, vector<double>(num_bicrits, prob),
+    vector<size_t>(num_bicrits, 0), num_samples, num_threads, rand_seed, candidates, stats,
+    adaptive);
+
+  return ret;
+}
+
+std::vector<std::unique_ptr<std::vector<datatypes::Bicriteria>>> max_prob_bicriteria_levels(
+    const graph::Sampler& sampler,
+    const std::vector<float>& levels,
+    const std::vector<double>& probs,
+    const std::unique_ptr<std::vector<datatypes::LInt>>& seed_sizes,
+    const int& num_samples,
+    const int& num_threads,
+    const int& rand_seed,
+    const double& candidates,
+    GreedyStats* stats) {
+
+  auto num_levels = std::max<size_t>(1, levels.size());
+  auto num_sizes = seed_sizes->size();
+
+  // one bicrit per level, prob and seed size, in that order.
+  auto bicrits = vector<Bicriteria>();
+  auto prob_of = vector<double>();
+  auto level_of = vector<size_t>();
+  for (size_t k = 0; k < num_levels; k++) {
+    for (auto& prob: probs) {
+      for (auto& size: *seed_sizes) {
+        bicrits.emplace_back(Bicriteria(size, sampler.num_nodes()));
+        prob_of.push_back(prob);
+        level_of.push_back(k);
+      }
+    }
   }
 
-  auto num_steps = std::llround(std::log(nodes->size()) / std::log(2));
+  _bicriteria_rounds(
+    sampler, levels, bicrits, prob_of, level_of, num_samples, num_threads, rand_seed,
+    candidates, stats, nullptr);
 
-  for (size_t e = 0; e < num_steps; e++) {
-    auto csc = _get_samples_collection(graph_edges, nodes, dices, num_samples, num_threads);
-    for (size_t i = 0; i < num_bicrits; i++) {
-      _update_feasibility(ret->at(i), csc, prob);
+  auto ret = vector<unique_ptr<vector<Bicriteria>>>();
+  for (size_t g = 0; g < num_levels * probs.size(); g++) {
+    ret.push_back(make_unique<vector<Bicriteria>>(
+      bicrits.begin() + g * num_sizes, bicrits.begin() + (g + 1) * num_sizes));
+  }
+  return ret;
+}
+
+// rr sets 0 .. size() - 1 of the rand_seed stream, stored back to back.
+struct RRCollection {
+  vector<LInt> offsets;
+  vector<VInt> nodes;
+
+  RRCollection() : offsets(1, 0) {}
+
+  inline LInt size() const { return offsets.size() - 1; }
+};
+
+// draws sets size() .. target - 1 in chunks of 256, which the threads take as
+// they free up; each chunk goes to its own part and the parts are appended in
+// chunk order, so the sets come out in index order however they were spread.
+void _extend_rr_sets(
+    const graph::RRSampler& rr_sampler,
+    const int& rand_seed,
+    const LInt& target,
+    const int& num_threads,
+    RRCollection& rr) {
+
+  auto first = rr.size();
+  if (target <= first) return;
+
+  const LInt chunk = 256;
+  auto parts = vector<RRCollection>((target - first + chunk - 1) / chunk);
+
+  auto loop = SampleLoop();
+  #pragma omp parallel num_threads(num_threads)
+  {
+    auto visited = vector<char>(rr_sampler.num_nodes(), 0);
+    auto timer = LoopTimer(loop);
+
+    #pragma omp for schedule(dynamic) nowait
+    for (size_t c = 0; c < parts.size(); c++) {
+      auto& part = parts[c];
+      auto hi = std::min(target, first + (LInt)(c + 1) * chunk);
+      for (LInt j = first + c * chunk; j < hi; j++) {
+        rr_sampler.sample(rand_seed, j, visited, part.nodes);
+        part.offsets.push_back(part.nodes.size());
+        timer.samples++;
+      }
     }
+    timer.stop();
+  }
+
+  for (auto& part: parts) {
+    auto base = rr.nodes.size();
+    rr.nodes.insert(rr.nodes.end(), part.nodes.begin(), part.nodes.end());
+    for (LInt j = 1; j <= part.size(); j++) rr.offsets.push_back(base + part.offsets[j]);
+  }
+}
+
+// greedy max coverage of the rr sets by seed_size nodes, over an inverted
+// index from each node to the sets holding it. the measure of a seed is the
+// number of sets it newly covers; ties go to the smallest id.
+vector<NodeMeasure> _select_rr_seeds(
+    const RRCollection& rr,
+    const LInt& n,
+    const int& seed_size) {
+
+  auto degree = vector<LInt>(n, 0);
+  for (auto& v: rr.nodes) degree[v]++;
+
+  auto index_offsets = vector<LInt>(n + 1, 0);
+  std::partial_sum(degree.begin(), degree.end(), index_offsets.begin() + 1);
+  auto fill = vector<LInt>(index_offsets.begin(), index_offsets.end() - 1);
+  auto index = vector<LInt>(rr.nodes.size());
+  for (LInt j = 0; j < rr.size(); j++) {
+    for (LInt k = rr.offsets[j]; k < rr.offsets[j + 1]; k++) index[fill[rr.nodes[k]]++] = j;
+  }
+
+  auto covered = vector<char>(rr.size(), 0);
+  auto ret = vector<NodeMeasure>();
+  ret.reserve(seed_size);
+
+  for (int i = 0; i < seed_size; i++) {
+    auto best = std::max_element(degree.begin(), degree.end()) - degree.begin();
+    ret.emplace_back(NodeMeasure(best, degree[best]));
+
+    for (LInt k = index_offsets[best]; k < index_offsets[best + 1]; k++) {
+      auto j = index[k];
+      if (covered[j]) continue;
+      covered[j] = 1;
+      for (LInt l = rr.offsets[j]; l < rr.offsets[j + 1]; l++) degree[rr.nodes[l]]--;
+    }
+    degree[best] = -1;
   }
 
   return ret;
 }
 
+// IMM (Tang, Shi and Xiao, 2015): the number of rr sets theta is sized from a
+// lower bound on the optimum found by doubling, so that the greedy seeds are a
+// (1 - 1/e - epsilon)-approximation with probability 1 - delta.
+std::unique_ptr<std::vector<datatypes::NodeMeasure>> max_exp_infl_imm(
+    const graph::Sampler& sampler,
+    const int& seed_size,
+    const double& epsilon,
+    const double& delta,
+    const int& num_threads,
+    const int& rand_seed,
+    datatypes::LInt& num_rr_sets) {
+
+  auto rr_sampler = graph::RRSampler(sampler.graph());
+  LInt n = sampler.num_nodes();
+  int k = std::min<LInt>(seed_size, n);
+
+  double log_n = std::log(std::max<LInt>(n, 2));
+  double ell = std::log(1 / delta) / log_n;
+  ell *= 1 + std::log(2) / log_n;
+  double log_cnk = std::lgamma(n + 1.0) - std::lgamma(k + 1.0) - std::lgamma(n - k + 1.0);
+
+  auto rr = RRCollection();
+  auto coverage = [&](const vector<NodeMeasure>& seeds) -> double {
+    LInt c = 0;
+    for (auto& u: seeds) c += u.measure;
+    return (double)c / rr.size();
+  };
+
+  // sampling: halve the guess x of the optimum until the greedy seeds on
+  // lambda' / x sets reach (1 + epsilon') x.
+  double eps_p = std::sqrt(2) * epsilon;
+  double lambda_p = (2 + 2 * eps_p / 3) *
+    (log_cnk + ell * log_n + std::log(std::max(1.0, std::log2(n)))) * n / (eps_p * eps_p);
+  double lb = 1;
+  for (int i = 1; i < std::log2(n); i++) {
+    double x = n / std::pow(2, i);
+    _extend_rr_sets(rr_sampler, rand_seed, std::ceil(lambda_p / x), num_threads, rr);
+    double infl = n * coverage(_select_rr_seeds(rr, n, k));
+    if (infl >= (1 + eps_p) * x) {
+      lb = infl / (1 + eps_p);
+      break;
+    }
+  }
+
+  double e = std::exp(1);
+  double alpha = std::sqrt(ell * log_n + std::log(2));
+  double beta = std::sqrt((1 - 1 / e) * (log_cnk + ell * log_n + std::log(2)));
+  double lambda_s = 2 * n * std::pow((1 - 1 / e) * alpha + beta, 2) / (epsilon * epsilon);
+  _extend_rr_sets(rr_sampler, rand_seed, std::ceil(lambda_s / lb), num_threads, rr);
+  num_rr_sets = rr.size();
+
+  // the measure of each seed is its estimated marginal influence.
+  auto kset = make_unique<vector<NodeMeasure>>(_select_rr_seeds(rr, n, k));
+  for (auto& u: *kset) u.measure = std::llround((double)u.measure * n / rr.size());
+
+  return kset;
+}
+
 }
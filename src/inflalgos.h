@@ -5,34 +5,164 @@
 #include <vector>
 #include "datatypes.h"
 #include "util.h"
+#include "graph.h"
 
 namespace inflalgos {
 
+  // how many nodes the lazy (CELF) greedy steps scored, and how many more a
+  // step scoring every candidate would have.
+  struct GreedyStats {
+    datatypes::LInt evaluations;
+    datatypes::LInt skipped;
+
+    GreedyStats() : evaluations(0), skipped(0) {}
+  };
+
+  // per OS thread that ran the loops over samples (and rr sets), the samples it
+  // ran and the seconds it was busy with them, summed since the last reset.
+  // loop_busy is the threads' busy seconds summed over every run of a loop,
+  // and loop_span what they would have been had each team's threads all been
+  // busy as long as its longest, so loop_busy / loop_span is 1 when every loop
+  // was balanced, however the teams were nested. the loops hand out small
+  // chunks as threads free up, and every sample draws from its own stream, so
+  // how they are spread never changes a result.
+  struct ThreadUtilization {
+    std::vector<datatypes::LInt> samples;
+    std::vector<double> busy;
+    double loop_busy;
+    double loop_span;
+
+    ThreadUtilization() : loop_busy(0), loop_span(0) {}
+  };
+
+  ThreadUtilization thread_utilization();
+  void reset_thread_utilization();
+
+  // with adaptive sampling, num_samples is a cap: an exact-quantile greedy step
+  // of max_prob_infl, or a feasibility round of max_prob_bicriteria, starts
+  // from min_samples and doubles them until it is decided with the given
+  // confidence, which covers all of its looks (and, for a quantile step, all
+  // of the nodes). a quantile step is decided once no other node can beat the
+  // best by more than tolerance. samples_used gets the count each step or
+  // round ended on. max_prob_infl throws std::invalid_argument when given one
+  // without exact_quantile.
+  struct AdaptiveSampling {
+    int min_samples;
+    double confidence;
+    datatypes::LInt tolerance;
+    std::vector<datatypes::LInt> samples_used;
+
+    AdaptiveSampling(int min_samples, double confidence, datatypes::LInt tolerance) :
+      min_samples(min_samples), confidence(confidence), tolerance(tolerance) {}
+  };
+
+  // samples first_sample .. first_sample + num_samples - 1 of the rand_seed
+  // stream, as every collection of the algorithms is made: mapped from the
+  // sampler's store if an earlier run left them there, otherwise drawn by
+  // num_threads threads and stored, through a file when they are over the
+  // sampler's memory budget. a fresh collection, one greedy step's own, is
+  // always drawn and never stored.
+  std::unique_ptr<std::vector<datatypes::PackedCover>> get_samples_collection(
+    const graph::Sampler& sampler,
+    const int& rand_seed,
+    const datatypes::LInt& first_sample,
+    const int& num_samples,
+    const int& num_threads,
+    const bool& fresh = false);
+
+  // unless fresh_samples, every greedy step (and every binary-search round of
+  // max_prob_infl) is evaluated against one shared collection of num_samples.
+  // with exact_quantile, max_prob_infl reads each candidate's empirical quantile
+  // from one set of samples instead of binary-searching it over ~log2(n) rounds.
+  // max_exp_infl's greedy steps on a shared collection are lazy (CELF) and
+  // count into stats. a quantile is not submodular, so max_prob_infl's are not.
+  // candidates > 0 prunes the greedy steps on a shared collection after the
+  // first to the nodes that scored best in it: a share of them if below 1,
+  // else a count.
   std::unique_ptr<std::vector<datatypes::NodeMeasure>> max_exp_infl(
-    const std::unique_ptr<datatypes::GraphByEdges>& graph_edges,
-    const std::unique_ptr<std::vector<datatypes::Node>>& nodes,
+    const graph::Sampler& sampler,
     const int& seed_size,
     const int& num_samples,
     const int& num_threads,
-    const int& rand_seed);
+    const int& rand_seed,
+    const bool& fresh_samples,
+    const double& candidates = 0,
+    GreedyStats* stats = nullptr);
 
   std::unique_ptr<std::vector<datatypes::NodeMeasure>> max_prob_infl(
-    const std::unique_ptr<datatypes::GraphByEdges>& graph_edges,
-    const std::unique_ptr<std::vector<datatypes::Node>>& nodes,
+    const graph::Sampler& sampler,
     const double& prob,
     const int& seed_size,
     const int& num_samples,
     const int& num_threads,
-    const int& rand_seed);
+    const int& rand_seed,
+    const bool& fresh_samples,
+    const bool& exact_quantile,
+    const double& candidates = 0,
+    AdaptiveSampling* adaptive = nullptr);
+
+  // expected influence from reverse-reachable sets, sized by IMM for an
+  // approximation slack epsilon and failure probability delta. the number of
+  // sets drawn is left in num_rr_sets.
+  std::unique_ptr<std::vector<datatypes::NodeMeasure>> max_exp_infl_imm(
+    const graph::Sampler& sampler,
+    const int& seed_size,
+    const double& epsilon,
+    const double& delta,
+    const int& num_threads,
+    const int& rand_seed,
+    datatypes::LInt& num_rr_sets);
 
   std::unique_ptr<std::vector<datatypes::Bicriteria>> max_prob_bicriteria(
-    const std::unique_ptr<datatypes::GraphByEdges>& graph_edges,
-    const std::unique_ptr<std::vector<datatypes::Node>>& nodes,
+    const graph::Sampler& sampler,
     const double& prob,
     const std::unique_ptr<std::vector<datatypes::LInt>>& seed_sizes,
     const int& num_samples,
     const int& num_threads,
-    const int& rand_seed);
+    const int& rand_seed,
+    const double& candidates = 0,
+    GreedyStats* stats = nullptr,
+    AdaptiveSampling* adaptive = nullptr);
+
+  // a grid of runs on common random numbers. the shared collection (and each
+  // bicriteria round's) is drawn once for every activation in levels by
+  // graph::Sampler::sample_packed_levels, so the levels see the same worlds,
+  // each grown by the extra live edges of the higher ones, and every prob is
+  // tested against them; no levels stands for the sampler's own activations.
+  // result k * probs.size() + i is the run at levels[k] and probs[i] (just
+  // levels[k] for max_exp_infl_levels), the same as the run on the graph read
+  // with activation levels[k] would give.
+  std::vector<std::unique_ptr<std::vector<datatypes::NodeMeasure>>> max_exp_infl_levels(
+    const graph::Sampler& sampler,
+    const std::vector<float>& levels,
+    const int& seed_size,
+    const int& num_samples,
+    const int& num_threads,
+    const int& rand_seed,
+    const double& candidates = 0,
+    GreedyStats* stats = nullptr);
+
+  std::vector<std::unique_ptr<std::vector<datatypes::NodeMeasure>>> max_prob_infl_levels(
+    const graph::Sampler& sampler,
+    const std::vector<float>& levels,
+    const std::vector<double>& probs,
+    const int& seed_size,
+    const int& num_samples,
+    const int& num_threads,
+    const int& rand_seed,
+    const bool& exact_quantile,
+    const double& candidates = 0);
+
+  std::vector<std::unique_ptr<std::vector<datatypes::Bicriteria>>> max_prob_bicriteria_levels(
+    const graph::Sampler& sampler,
+    const std::vector<float>& levels,
+    const std::vector<double>& probs,
+    const std::unique_ptr<std::vector<datatypes::LInt>>& seed_sizes,
+    const int& num_samples,
+    const int& num_threads,
+    const int& rand_seed,
+    const double& candidates = 0,
+    GreedyStats* stats = nullptr);
 }
 
 #endif
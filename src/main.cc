@@ -7,6 +7,9 @@
 #include <iomanip>
 #include <chrono>
 #include <algorithm>
+#include <numeric>
+#include <cmath>
+#include <stdexcept>
 #include <omp.h>
 #include "datatypes.h"
 #include "util.h"
@@ -29,30 +32,18 @@ using datatypes::LInt;
 using datatypes::GraphByEdges;
 using datatypes::Vertex;
 using datatypes::Edge;
-using datatypes::Graph;
-using datatypes::Node;
-using datatypes::ConnectedComp;
 using datatypes::NodeMeasure;
-using datatypes::NodeIndexedCover;
-using util::Dice;
-using util::STDice;
+using datatypes::PackedCover;
+using datatypes::SampleScratch;
 
 void evaluate_seed_set_by_node_attrb(
-    unique_ptr<GraphByEdges>& graph_edges,
-    unique_ptr<vector<Node>>& nodes,
+    const graph::Sampler& sampler,
     std::string& input2,
     int& num_samples_test,
     int& rand_seed_test) {
 
-  unique_ptr<Dice> dice = make_unique<STDice>(rand_seed_test);
-  auto testsets = make_unique<vector<unique_ptr<vector<NodeIndexedCover>>>>();
-
-  for (int i = 0; i < num_samples_test; i++) {
-    auto g = graph::sample_graph(graph_edges, nodes, dice);
-    auto cc = graph::connected_component(g);
-    auto nc = graph::get_cover(g);
-    testsets->emplace_back(std::move(nc));
-  }
+  auto testsets = inflalgos::get_samples_collection(
+    sampler, rand_seed_test, 0, num_samples_test, omp_get_max_threads());
 
   auto seed_set_str = make_unique<vector<string>>();
 
@@ -74,12 +65,13 @@ void evaluate_seed_set_by_node_attrb(
     [](string& s) -> LInt { return std::stoi(s); }
   );
 
+  auto& vertexes = sampler.graph()->vertexes;
   auto seed_set = make_unique<vector<LInt>>();
   for (auto& x: *seed_set_attrb) {
     auto find = std::find_if(
-      nodes->begin(), nodes->end(),
-      [&x](Node& u) { return u.attr == x; } );
-    seed_set->emplace_back((*find).id);
+      vertexes->begin(), vertexes->end(),
+      [&x](Vertex& u) { return std::get<1>(u) == x; } );
+    seed_set->emplace_back(std::get<0>(*find));
   }
 
   auto m = graph::calculate_total_cover_per_sample(seed_set, testsets);
@@ -101,13 +93,72 @@ void evaluate_seed_set_by_node_attrb(
   return;
 }
 
-int main(int argc, char** argv) {
+// the variance of the mean of per-sample covers, from the means of the
+// sampler's independent groups of group_size samples; a trailing partial
+// group is left out. nan with fewer than two groups.
+double variance_of_mean_cover(const vector<LInt>& covers, const LInt& group_size) {
+  LInt num_groups = covers.size() / group_size;
+  if (num_groups < 2) return std::nan("");
+
+  auto means = vector<double>(num_groups, 0);
+  for (LInt g = 0; g < num_groups; g++) {
+    for (LInt j = 0; j < group_size; j++) means[g] += covers[g * group_size + j];
+    means[g] /= group_size;
+  }
+
+  double mean = std::accumulate(means.begin(), means.end(), 0.0) / num_groups;
+  double ss = 0;
+  for (auto& x: means) ss += (x - mean) * (x - mean);
+  return ss / (num_groups - 1) / num_groups;
+}
+
+// a comma-separated list of numbers, as -a and -p take.
+vector<double> parse_numbers(const string& arg) {
+  auto ret = vector<double>();
+  auto iss = istringstream(arg);
+  string item;
+  while (getline(iss, item, ',')) ret.push_back(std::stod(item));
+  if (ret.empty()) ret.push_back(std::stod(arg));
+  return ret;
+}
+
+int run(int argc, char** argv) {
   auto ap = util::ArgParser(argc, argv);
 
   auto input = ap.get_arg("-f");
+  auto cache_dir = ap.get_arg("-cache");
+  auto store_dir = ap.get_arg("-store");
+  auto mem_budget_arg = ap.get_arg("-mem-budget");
+  auto sampling = ap.get_arg("-sampling");
+  if (sampling.empty()) sampling = "edge";
+  auto encoding = ap.get_arg("-encoding");
+  if (encoding.empty()) encoding = "dense";
+  auto design = ap.get_arg("-design");
+  if (design.empty()) design = "mc";
+  bool fresh_samples = (ap.get_arg("-freshsamp") == "1");
+  bool adaptive_sampling = (ap.get_arg("-adaptive") == "1");
+  auto eps_arg = ap.get_arg("-eps");
+  double epsilon = eps_arg.empty() ? 0.1 : std::stod(eps_arg);
+  auto imm_delta_arg = ap.get_arg("-immdelta");
+  auto candidates_arg = ap.get_arg("-candidates");
+  double candidates = candidates_arg.empty() ? 0 : std::stod(candidates_arg);
+  bool prune_check = (ap.get_arg("-prunecheck") == "1");
+  bool thread_stats = (ap.get_arg("-threadstats") == "1");
+  LInt pruned_seed_diffs = 0;
+  auto confidence_arg = ap.get_arg("-confidence");
+  auto min_samples_arg = ap.get_arg("-minsamp");
+  auto tolerance_arg = ap.get_arg("-tolerance");
+  auto adaptive = inflalgos::AdaptiveSampling(
+    min_samples_arg.empty() ? 32 : std::stoi(min_samples_arg),
+    confidence_arg.empty() ? 0.95 : std::stod(confidence_arg),
+    tolerance_arg.empty() ? 1 : std::stoll(tolerance_arg));
+  LInt num_rr_sets = 0;
+  auto greedy_stats = inflalgos::GreedyStats();
   int seed_size(0);
   double activation(0);
   double prob(0);
+  auto activations = vector<double>{0};
+  auto probs = vector<double>{0};
   int rand_seed(0);
   int rand_seed_input(0);
   int rand_seed_test(0);
@@ -119,8 +170,8 @@ int main(int argc, char** argv) {
 
   try {
     seed_size = std::stoi(ap.get_arg("-k"));
-    activation = std::stod(ap.get_arg("-a"));
-    prob = std::stod(ap.get_arg("-p"));
+    activations = parse_numbers(ap.get_arg("-a"));
+    probs = parse_numbers(ap.get_arg("-p"));
     rand_seed = std::stoi(ap.get_arg("-rs"));
     rand_seed_input = std::stoi(ap.get_arg("-rsin"));
     rand_seed_test = std::stoi(ap.get_arg("-rstest"));
@@ -133,90 +184,266 @@ int main(int argc, char** argv) {
     cout << "Warning: Some arguments are missing." << endl;
   }
 
-  auto batch_size = num_samples / num_threads;
-  if (num_samples > batch_size * num_threads)
-    num_samples = (batch_size + 1) * num_threads;
+  // max_prob_infl binary-searches each candidate's quantile unless asked to
+  // read it exactly; adaptive max_prob_infl steps need the exact reading, so
+  // it is their default and bisect is refused with them.
+  bool adaptive_quantile = adaptive_sampling && algorithm == "maxprobinfl";
+  auto quantile = ap.get_arg("-quantile");
+  if (quantile.empty()) quantile = adaptive_quantile ? "exact" : "bisect";
+  if (quantile != "bisect" && quantile != "exact") {
+    throw std::invalid_argument("unknown quantile mode: " + quantile);
+  }
+  bool exact_quantile = (quantile == "exact");
+  if (adaptive_quantile && !exact_quantile) {
+    throw std::invalid_argument("adaptive maxprobinfl needs -quantile exact");
+  }
+  if (adaptive_sampling && algorithm != "maxprobinfl" && algorithm != "maxprobbicritinfl") {
+    throw std::invalid_argument("adaptive sampling runs maxprobinfl or maxprobbicritinfl");
+  }
+
+  // more than one -a or -p value makes a sweep over the grid of them, run on
+  // common random numbers: the graph is read once, at the highest activation,
+  // and the lower ones are levels of its samples.
+  std::sort(activations.begin(), activations.end());
+  activations.erase(std::unique(activations.begin(), activations.end()), activations.end());
+  bool sweep = (activations.size() > 1 || probs.size() > 1);
+  activation = activations.back();
+  prob = probs[0];
+  auto levels = vector<float>();
+  if (activations.size() > 1) {
+    if (activations[0] <= 0) {
+      throw std::invalid_argument("an activation sweep needs positive -a values");
+    }
+    if (sampling != "edge") {
+      throw std::invalid_argument("an activation sweep needs -sampling edge");
+    }
+    levels.assign(activations.begin(), activations.end());
+  }
 
-  unique_ptr<GraphByEdges> graph_edges = graph::read_edges(input, activation, rand_seed_input);
-  unique_ptr<vector<Node>> nodes = graph::get_graph_nodes(graph_edges);
+  unique_ptr<GraphByEdges> graph_edges = cache_dir.empty() ?
+    graph::read_edges(input, activation, rand_seed_input) :
+    graph::read_edges_cached(input, activation, rand_seed_input, cache_dir);
+  auto sampler = graph::Sampler(
+    graph_edges, graph::parse_sampling_mode(sampling), graph::parse_cover_encoding(encoding),
+    graph::parse_sample_design(design));
+  sampler.set_store(store_dir);
+  if (!mem_budget_arg.empty()) sampler.set_mem_budget(util::parse_bytes(mem_budget_arg));
 
   auto result = make_unique<vector<NodeMeasure>>();
   auto seed_set = make_unique<vector<LInt>>();
   auto measure = make_unique<vector<LInt>>();
 
+  if (algorithm.compare("evaluate") == 0) {
+    evaluate_seed_set_by_node_attrb(sampler, input2, num_samples_test, rand_seed_test);
+    return 0;
+  }
+
+  auto select_seeds = [&](
+      const double& candidates,
+      inflalgos::GreedyStats* stats,
+      inflalgos::AdaptiveSampling* adaptive) {
+    auto ret = make_unique<vector<NodeMeasure>>();
+    if (algorithm.compare("maxexpinfl") == 0) {
+      ret = inflalgos::max_exp_infl(
+        sampler, seed_size, num_samples, num_threads, rand_seed, fresh_samples, candidates,
+        stats);
+    } else if (algorithm.compare("maxprobinfl") == 0) {
+      ret = inflalgos::max_prob_infl(
+        sampler, prob, seed_size, num_samples, num_threads, rand_seed, fresh_samples,
+        exact_quantile, candidates, adaptive);
+    } else if (algorithm.compare("imm") == 0) {
+      // IMM's customary failure probability is 1 / n.
+      double imm_delta = imm_delta_arg.empty() ?
+        1.0 / sampler.num_nodes() : std::stod(imm_delta_arg);
+      ret = inflalgos::max_exp_infl_imm(
+        sampler, seed_size, epsilon, imm_delta, num_threads, rand_seed, num_rr_sets);
+    } else if (algorithm.compare("maxprobbicritinfl") == 0) {
+      auto seed_sizes = make_unique<vector<LInt>>();
+      seed_sizes->emplace_back(seed_size);
+
+      auto bc = inflalgos::max_prob_bicriteria(
+        sampler, prob, seed_sizes, num_samples, num_threads, rand_seed, candidates, stats,
+        adaptive);
+
+      ret->reserve(seed_size);
+      for (auto& u: bc->at(0).seed_set) {
+        ret->emplace_back(u);
+      }
+    }
+    return ret;
+  };
+
+  // the sweep covers the algorithms that run on shared collections.
+  if (sweep && (fresh_samples || adaptive_sampling || (
+      algorithm != "maxexpinfl" && algorithm != "maxprobinfl" &&
+      algorithm != "maxprobbicritinfl"))) {
+    throw std::invalid_argument(
+      "a sweep runs maxexpinfl, maxprobinfl or maxprobbicritinfl on shared samples");
+  }
+
+  // results[k * probs.size() + i] is the run at activations[k] and probs[i].
+  auto results = vector<unique_ptr<vector<NodeMeasure>>>();
+
+  inflalgos::reset_thread_utilization();
   auto start = high_resolution_clock::now();
 
-  if (algorithm.compare("maxexpinfl") == 0) {
-    result = inflalgos::max_exp_infl(
-      graph_edges, nodes, seed_size, num_samples, num_threads, rand_seed);
+  if (!sweep) {
+    results.push_back(
+      select_seeds(candidates, &greedy_stats, adaptive_sampling ? &adaptive : nullptr));
+  } else if (algorithm.compare("maxexpinfl") == 0) {
+    auto by_level = inflalgos::max_exp_infl_levels(
+      sampler, levels, seed_size, num_samples, num_threads, rand_seed, candidates,
+      &greedy_stats);
+    for (auto& r: by_level) {
+      for (size_t i = 0; i < probs.size(); i++) {
+        results.push_back(make_unique<vector<NodeMeasure>>(*r));
+      }
+    }
   } else if (algorithm.compare("maxprobinfl") == 0) {
-    result = inflalgos::max_prob_infl(
-      graph_edges, nodes, prob, seed_size, num_samples, num_threads, rand_seed);
-  } else if (algorithm.compare("maxprobbicritinfl") == 0) {
+    results = inflalgos::max_prob_infl_levels(
+      sampler, levels, probs, seed_size, num_samples, num_threads, rand_seed, exact_quantile,
+      candidates);
+  } else {
     auto seed_sizes = make_unique<vector<LInt>>();
     seed_sizes->emplace_back(seed_size);
-
-    auto bc = inflalgos::max_prob_bicriteria(
-      graph_edges, nodes, prob, seed_sizes, num_samples, num_threads, rand_seed);
-
-    result->reserve(seed_size);
-    for (auto& u: bc->at(0).seed_set) {
-      result->emplace_back(u);
+    auto bcs = inflalgos::max_prob_bicriteria_levels(
+      sampler, levels, probs, seed_sizes, num_samples, num_threads, rand_seed, candidates,
+      &greedy_stats);
+    for (auto& bc: bcs) {
+      results.push_back(make_unique<vector<NodeMeasure>>(bc->at(0).seed_set));
     }
-  } else if (algorithm.compare("evaluate") == 0) {
-    evaluate_seed_set_by_node_attrb(graph_edges, nodes, input2, num_samples_test, rand_seed_test);
-    return 0;
   }
 
   auto stop = high_resolution_clock::now();
   auto exec_time = duration_cast<std::chrono::seconds>(stop - start);
-
-  for (auto& id_val: *result) {
-    seed_set->push_back(id_val.id);
+  auto utilization = inflalgos::thread_utilization();
+
+  // the seeds a pruned run picked that the same run without pruning did not.
+  if (!sweep && candidates > 0 && prune_check) {
+    auto check = inflalgos::AdaptiveSampling(
+      adaptive.min_samples, adaptive.confidence, adaptive.tolerance);
+    auto unpruned = select_seeds(0, nullptr, adaptive_sampling ? &check : nullptr);
+    for (auto& x: *results[0]) {
+      bool found = std::any_of(unpruned->begin(), unpruned->end(),
+        [&x](const NodeMeasure& y) { return y.id == x.id; });
+      if (!found) pruned_seed_diffs++;
+    }
   }
 
-  unique_ptr<Dice> dice = make_unique<STDice>(rand_seed_test);
-  auto testsets = make_unique<vector<unique_ptr<vector<NodeIndexedCover>>>>();
-
-  for (int i = 0; i < num_samples_test; i++) {
-    auto s = graph::sample_graph(graph_edges, nodes, dice);
-    auto cc = graph::connected_component(s);
-    auto nc = graph::get_cover(s);
-    testsets->emplace_back(std::move(nc));
+  // the test samples of every activation, from the same worlds as well.
+  auto testsets = vector<unique_ptr<vector<PackedCover>>>();
+  if (levels.empty()) {
+    testsets.push_back(inflalgos::get_samples_collection(
+      sampler, rand_seed_test, 0, num_samples_test, num_threads));
+  } else {
+    for (size_t k = 0; k < activations.size(); k++) {
+      testsets.push_back(make_unique<vector<PackedCover>>(num_samples_test));
+    }
+    auto scratch = SampleScratch(sampler.num_nodes());
+    auto packed = vector<PackedCover*>();
+    for (auto& t: testsets) packed.push_back(t->data());
+    sampler.sample_packed_levels(rand_seed_test, 0, num_samples_test, levels, scratch, packed);
   }
 
-  measure = graph::calculate_accumulative_average_cover(seed_set, testsets);
-
   std::ofstream file;
   file.open("output.txt", std::ofstream::out | std::ofstream::app);
 
   auto cout_buff = std::cout.rdbuf();
   std::cout.rdbuf(file.rdbuf());
 
-  cout << "[" << input << ", k=" << seed_size << ", activation=" << activation
-    << ", delta=" << prob << ", samples=" << num_samples << ", algorithm=" << algorithm
-    << ", random_seed=" << rand_seed << ", random_seed_input=" << rand_seed_input
-    << ", random_seed_test=" << rand_seed_test << ", samples_test=" << num_samples_test
-    << "]" << endl;
-  cout << "time in secs: " << exec_time.count() << endl;
-
-  for (size_t i = 0; i < seed_set->size(); i++) {
-    auto& u = seed_set->at(i);
-    auto& attr = nodes->at(u).attr;
-    auto& msr_found = result->at(i).measure;
-    auto& msr_test = measure->at(i);
-
-    cout << std::left <<
-      std::setw(30) << "Node(" + std::to_string(u) + ", " + std::to_string(attr) + ")" <<
-      std::setw(30) << msr_found <<
-      std::setw(30) << msr_test << endl;
+  for (size_t k = 0; k < activations.size(); k++) {
+    for (size_t i = 0; i < probs.size(); i++) {
+      activation = activations[k];
+      prob = probs[i];
+      result = std::move(results[k * probs.size() + i]);
+      auto& testset = testsets[k];
+
+      seed_set->clear();
+      for (auto& id_val: *result) {
+        seed_set->push_back(id_val.id);
+      }
+
+      measure = graph::calculate_accumulative_average_cover(seed_set, testset);
+      double test_variance = variance_of_mean_cover(
+        *graph::calculate_total_cover_per_sample(seed_set, testset), sampler.group_size());
+
+      cout << "[" << input << ", k=" << seed_size << ", activation=" << activation
+        << ", delta=" << prob << ", samples=" << num_samples << ", algorithm=" << algorithm
+        << ", random_seed=" << rand_seed << ", random_seed_input=" << rand_seed_input
+        << ", random_seed_test=" << rand_seed_test << ", samples_test=" << num_samples_test
+        << ", sampling=" << sampling << ", fresh_samples=" << fresh_samples
+        << ", exact_quantile=" << exact_quantile << ", encoding=" << encoding
+        << ", design=" << design << ", test_mean_variance=" << test_variance;
+      if (sweep) {
+        cout << ", sweep=" << activations.size() << "x" << probs.size();
+      }
+      if (algorithm.compare("imm") == 0) {
+        cout << ", epsilon=" << epsilon
+          << ", imm_delta=" << (imm_delta_arg.empty() ? "1/n" : imm_delta_arg)
+          << ", rr_sets=" << num_rr_sets;
+      }
+      if (adaptive_sampling) {
+        cout << ", confidence=" << adaptive.confidence
+          << ", min_samples=" << adaptive.min_samples << ", tolerance=" << adaptive.tolerance
+          << ", samples_used=";
+        for (size_t j = 0; j < adaptive.samples_used.size(); j++) {
+          cout << (j > 0 ? "/" : "") << adaptive.samples_used[j];
+        }
+      }
+      if (candidates > 0) {
+        cout << ", candidates=" << candidates_arg;
+        if (prune_check && !sweep) cout << ", pruned_seed_diffs=" << pruned_seed_diffs;
+      }
+      if (greedy_stats.evaluations + greedy_stats.skipped > 0) {
+        cout << ", lazy_evaluations=" << greedy_stats.evaluations
+          << ", lazy_skipped=" << greedy_stats.skipped;
+      }
+      // the timed run's sample loops: samples and busy seconds per thread, and
+      // the busy time of each loop's team over its longest thread's, 1 when
+      // every loop was perfectly balanced.
+      if (thread_stats && !utilization.busy.empty()) {
+        auto& busy = utilization.busy;
+        cout << ", thread_samples=";
+        for (size_t j = 0; j < busy.size(); j++) {
+          cout << (j > 0 ? "/" : "") << utilization.samples[j];
+        }
+        cout << ", thread_busy=";
+        for (size_t j = 0; j < busy.size(); j++) cout << (j > 0 ? "/" : "") << busy[j];
+        cout << ", thread_balance=" << utilization.loop_busy / utilization.loop_span;
+      }
+      cout << "]" << endl;
+      cout << "time in secs: " << exec_time.count() << endl;
+
+      for (size_t j = 0; j < seed_set->size(); j++) {
+        auto& u = seed_set->at(j);
+        auto& attr = std::get<1>(graph_edges->vertexes->at(u));
+        auto& msr_found = result->at(j).measure;
+        auto& msr_test = measure->at(j);
+
+        cout << std::left <<
+          std::setw(30) << "Node(" + std::to_string(u) + ", " + std::to_string(attr) + ")" <<
+          std::setw(30) << msr_found <<
+          std::setw(30) << msr_test << endl;
+      }
+
+      cout << "---------------" << std::endl;
+    }
   }
 
-  cout << "---------------" << std::endl;
-
   file.close();
   std::cout.rdbuf(cout_buff);
   std::cout << "Done!" << std::endl;
 
   return 0;
 }
+
+// bad option values, unreadable inputs and unsupported combinations surface as
+// exceptions; report them rather than abort.
+int main(int argc, char** argv) {
+  try {
+    return run(argc, argv);
+  } catch (const std::exception& e) {
+    cout << "Error: " << e.what() << endl;
+    return 1;
+  }
+}
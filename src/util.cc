@@ -3,6 +3,13 @@
 #include <tuple>
 #include <memory>
 #include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <cctype>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "util.h"
 
 namespace util {
@@ -24,6 +31,44 @@ const std::string& ArgParser::get_arg(const std::string &arg) const {
   return empty_str;
 }
 
+MappedFile::MappedFile(const std::string &fname) : addr(nullptr), len(0) {
+  int fd = open(fname.c_str(), O_RDONLY);
+  if (fd < 0) throw std::runtime_error("cannot open " + fname);
+
+  struct stat st;
+  if (fstat(fd, &st) == 0) len = st.st_size;
+
+  if (len > 0) {
+    void* p = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (p == MAP_FAILED) {
+      close(fd);
+      throw std::runtime_error("cannot map " + fname);
+    }
+    addr = static_cast<const char*>(p);
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile() {
+  if (addr != nullptr) munmap(const_cast<char*>(addr), len);
+}
+
+long long parse_bytes(const std::string &arg) {
+  size_t end = 0;
+  double x = std::stod(arg, &end);
+  auto unit = std::string("kmgt");
+  long long scale = 1;
+  if (x < 0) throw std::invalid_argument("bad byte count " + arg);
+  if (end + 1 == arg.size()) {
+    auto u = unit.find(std::tolower(arg[end]));
+    if (u == std::string::npos) throw std::invalid_argument("bad byte count " + arg);
+    scale <<= 10 * (u + 1);
+  } else if (end != arg.size()) {
+    throw std::invalid_argument("bad byte count " + arg);
+  }
+  return std::llround(x * scale);
+}
+
 STDice::STDice(int seed) : engine(seed), distribution(std::uniform_real_distribution<>(0, 1)) {}
 
 STDice::STDice(int seed, double l, double r) :
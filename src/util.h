@@ -3,6 +3,10 @@
 
 #include <atomic>
 #include <random>
+#include <string>
+#include <vector>
+#include <array>
+#include <cstdint>
 
 namespace util {
 
@@ -15,6 +19,61 @@ struct ArgParser {
   const std::string& get_arg(const std::string &arg) const;
 };
 
+// read-only private mapping of a whole file, unmapped on destruction.
+class MappedFile {
+public:
+  MappedFile(const std::string &fname);
+  ~MappedFile();
+
+  MappedFile (const MappedFile&) = delete;
+  MappedFile& operator= (const MappedFile&) = delete;
+
+  inline const char* data() const { return addr; }
+  inline size_t size() const { return len; }
+private:
+  const char* addr;
+  size_t len;
+};
+
+// a read-only array that either owns its elements or views memory owned by
+// someone else, such as a MappedFile.
+template <typename T>
+class Array {
+public:
+  Array() : ptr(nullptr), len(0) {}
+  Array(std::vector<T> &&v) : owned(std::move(v)), ptr(owned.data()), len(owned.size()) {}
+  Array(const T* p, size_t n) : ptr(p), len(n) {}
+
+  Array (Array&&) = default;
+  Array& operator= (Array&&) = default;
+  Array (const Array&) = delete;
+  Array& operator= (const Array&) = delete;
+
+  inline const T& operator[](size_t i) const { return ptr[i]; }
+  inline const T* data() const { return ptr; }
+  inline size_t size() const { return len; }
+  inline const T* begin() const { return ptr; }
+  inline const T* end() const { return ptr + len; }
+
+  // hands back the owned elements for reuse, leaving the array empty; nothing
+  // if it viewed someone else's.
+  std::vector<T> release() {
+    auto v = std::move(owned);
+    owned = std::vector<T>();
+    ptr = nullptr;
+    len = 0;
+    return v;
+  }
+private:
+  std::vector<T> owned;
+  const T* ptr;
+  size_t len;
+};
+
+// a byte count such as "8G", "512M", "64k" or "1000000", in powers of 1024;
+// throws std::invalid_argument otherwise.
+long long parse_bytes(const std::string &arg);
+
 class Dice {
 public:
   virtual double roll() = 0;
@@ -31,6 +90,76 @@ private:
   std::uniform_real_distribution<> distribution;
 };
 
+// Philox4x32-10 (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+// each 4-word block is a pure function of (seed, stream, index), so any draw of
+// any stream can be regenerated without replaying the ones before it.
+class Philox {
+public:
+  using Block = std::array<std::uint32_t, 4>;
+
+  Philox(std::uint64_t seed, std::uint64_t stream) :
+    key{static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32)},
+    stream{static_cast<std::uint32_t>(stream), static_cast<std::uint32_t>(stream >> 32)} {}
+
+  inline Block block(std::uint64_t index) const {
+    Block ctr = {
+      static_cast<std::uint32_t>(index), static_cast<std::uint32_t>(index >> 32),
+      stream[0], stream[1]};
+    std::uint32_t k0 = key[0], k1 = key[1];
+
+    for (int r = 0; r < 10; r++) {
+      std::uint64_t p0 = std::uint64_t(0xD2511F53) * ctr[0];
+      std::uint64_t p1 = std::uint64_t(0xCD9E8D57) * ctr[2];
+      ctr = {
+        static_cast<std::uint32_t>(p1 >> 32) ^ ctr[1] ^ k0, static_cast<std::uint32_t>(p1),
+        static_cast<std::uint32_t>(p0 >> 32) ^ ctr[3] ^ k1, static_cast<std::uint32_t>(p0)};
+      k0 += 0x9E3779B9;
+      k1 += 0xBB67AE85;
+    }
+    return ctr;
+  }
+
+  // key[0], key[1], stream[0], stream[1], for kernels that run several
+  // blocks side by side.
+  inline std::array<std::uint32_t, 4> words() const {
+    return {key[0], key[1], stream[0], stream[1]};
+  }
+
+  // uniform in [0, 1) from the top 24 bits, exact as a float.
+  static inline float to_float(std::uint32_t x) { return (x >> 8) * (1.0f / 16777216); }
+
+  // uniform in [0, 1) with 53 bits.
+  static inline double to_double(std::uint32_t hi, std::uint32_t lo) {
+    return ((std::uint64_t(hi) << 21) ^ (lo >> 11)) * (1.0 / 9007199254740992.0);
+  }
+
+private:
+  std::uint32_t key[2];
+  std::uint32_t stream[2];
+};
+
+// sequential draws from one Philox stream, two doubles per block.
+// not a Dice: it sits in the per-edge sampling loops, so roll() is not virtual.
+class CounterDice {
+public:
+  CounterDice(std::uint64_t seed, std::uint64_t stream) :
+    gen(seed, stream), index(0), pos(4) {}
+
+  inline double roll() {
+    if (pos == 4) {
+      buf = gen.block(index++);
+      pos = 0;
+    }
+    pos += 2;
+    return Philox::to_double(buf[pos - 2], buf[pos - 1]);
+  }
+private:
+  Philox gen;
+  std::uint64_t index;
+  int pos;
+  Philox::Block buf;
+};
+
 class MTDice : public Dice {
 public:
   MTDice(int seed);